@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+# Measure how fast the shell runs a script of builtins only.
+#
+# Usage: bench/script_throughput.sh [path/to/shell] [lines]
+
+set -e
+
+SHELL_BIN=${1:-./build/shell}
+LINES=${2:-100000}
+SCRIPT=$(mktemp)
+trap 'rm -f "$SCRIPT"' EXIT
+
+# Cycle through a few builtins so no single one dominates
+awk -v lines="$LINES" 'BEGIN {
+    for (i = 0; i < lines; i++)
+        if (i % 4 == 0)      print "echo line " i " of the benchmark script"
+        else if (i % 4 == 1) print "type echo"
+        else if (i % 4 == 2) print "pwd"
+        else                 print "echo a b c d e f g h && echo done"
+}' >"$SCRIPT"
+
+now() { date +%s%N; }
+
+run() {
+    start=$(now)
+    "$@" >/dev/null
+    end=$(now)
+    elapsed=$(((end - start) / 1000000))
+    rate=$((LINES * 1000 / (elapsed > 0 ? elapsed : 1)))
+    printf '%-8s %8d lines %8d ms %10d lines/s\n' "$MODE" "$LINES" \
+        "$elapsed" "$rate"
+}
+
+MODE=file run "$SHELL_BIN" "$SCRIPT"
+MODE=stdin run sh -c '"$0" <"$1"' "$SHELL_BIN" "$SCRIPT"
+MODE=pipe run sh -c 'cat "$1" | "$0"' "$SHELL_BIN" "$SCRIPT"
@@ -0,0 +1,353 @@
+#include "command_table.h"
+#include "glob_expander.h"
+#include "parser.h"
+#include "shell.h"
+#include "trie.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * The micro-benchmarks of the shell: the parser, the completion tree, the
+ * command table, the completion, the globbing, the round trip of a command
+ * and the command substitution.
+ *
+ * Usage: shell_bench [--filter text] [--baseline file] [--write file]
+ *                    [--threshold percent]
+ *
+ * Each benchmark runs in batches grown until a batch takes 20 ms, and the
+ * best of 5 batches is kept, so a busy machine mostly makes it slower, not
+ * noisier. With `--baseline`, a benchmark slower than the baseline by more
+ * than the threshold is a regression and the status is 1.
+ */
+
+namespace fs = std::filesystem;
+
+namespace
+{
+constexpr auto   BATCH_TIME = std::chrono::milliseconds(20);
+constexpr size_t BATCHES    = 5;
+
+struct Benchmark
+{
+    std::string           name;
+    size_t                operations; /* Done by one call of the body */
+    std::function<void()> body;
+};
+
+/**
+ *@brief Keep the compiler from dropping a computation
+ */
+template <typename T> void keep(const T & value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+ *@brief Measure the best time of one operation of a benchmark
+ *
+ * @return double the nanoseconds per operation
+ */
+double measure(const Benchmark & benchmark)
+{
+    using clock = std::chrono::steady_clock;
+
+    auto run = [&](size_t calls) {
+        auto start = clock::now();
+        for (size_t i = 0; i < calls; i++)
+            benchmark.body();
+        return clock::now() - start;
+    };
+
+    size_t calls = 1;
+    while (run(calls) < BATCH_TIME && calls < (size_t(1) << 30))
+        calls *= 2;
+
+    double best = 1e300;
+    for (size_t batch = 0; batch < BATCHES; batch++)
+        best = std::min(
+            best, std::chrono::duration<double, std::nano>(run(calls)).count() /
+                      (calls * benchmark.operations));
+
+    return best;
+}
+
+/**
+ *@brief Make names like a PATH holds: `cmd0`, `git-log`, `x86_64-gcc-12`...
+ */
+std::vector<std::string> syntheticNames(size_t count)
+{
+    static constexpr std::string_view STEMS[] = {
+        "cmd", "git-", "x86_64-linux-gnu-gcc-", "python3.", "lib", "k"};
+
+    std::vector<std::string> names;
+    names.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        names.push_back(std::string(STEMS[i % std::size(STEMS)]) +
+                        std::to_string(i * 7919 % count));
+
+    return names;
+}
+
+/**
+ *@brief A temporary tree of PATH directories full of programs
+ */
+class PathTree
+{
+private:
+    std::string root;
+
+public:
+    PathTree(size_t directories, size_t programs)
+    {
+        char pattern[] = "/tmp/shell_bench.XXXXXX";
+        root           = mkdtemp(pattern) ? pattern : "";
+
+        for (size_t d = 0; d < directories; d++)
+        {
+            fs::path directory = fs::path(root) / ("bin" + std::to_string(d));
+            fs::create_directory(directory);
+            for (size_t p = 0; p < programs; p++)
+            {
+                fs::path program =
+                    directory / ("cmd" + std::to_string(d * programs + p));
+                std::ofstream(program) << "#!/bin/sh\n";
+                chmod(program.c_str(), 0755);
+            }
+        }
+    }
+    ~PathTree()
+    {
+        if (!root.empty())
+            fs::remove_all(root);
+    }
+
+    PathTree(const PathTree &)             = delete;
+    PathTree & operator=(const PathTree &) = delete;
+
+    const std::string & Root() const { return root; }
+
+    /**
+     *@brief Get the PATH of the directories, in order
+     */
+    std::string PathVariable() const
+    {
+        std::string path;
+        for (const auto & entry : fs::directory_iterator(root))
+            path += (path.empty() ? "" : ":") + entry.path().string();
+        return path;
+    }
+};
+
+std::map<std::string, double> readBaseline(const std::string & file)
+{
+    std::map<std::string, double> baseline;
+    std::ifstream                 in(file);
+    std::string                   name;
+    double                        value = 0;
+
+    for (std::string line; std::getline(in, line);)
+    {
+        if (line.empty() || line.starts_with('#'))
+            continue;
+
+        // The name is everything before the last field
+        size_t space = line.find_last_of(' ');
+        if (space == std::string::npos)
+            continue;
+        name  = line.substr(0, line.find_last_not_of(' ', space) + 1);
+        value = std::atof(line.c_str() + space + 1);
+        baseline[name] = value;
+    }
+
+    return baseline;
+}
+} // namespace
+
+int main(int argc, char * argv[])
+{
+    std::string filter, baseline_file, write_file;
+    double      threshold = 25;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string_view option = argv[i];
+        if (option == "--filter")
+            filter = argv[i + 1];
+        else if (option == "--baseline")
+            baseline_file = argv[i + 1];
+        else if (option == "--write")
+            write_file = argv[i + 1];
+        else if (option == "--threshold")
+            threshold = std::atof(argv[i + 1]);
+        else
+        {
+            std::cerr << "shell_bench: " << option << ": invalid option\n";
+            return 2;
+        }
+    }
+
+    // Keep the user's command index and history out of the measures
+    setenv("SHELL_COMMAND_INDEX", "", 1);
+    setenv("HISTFILE", "", 1);
+
+    PathTree    tree(20, 500);
+    std::string path_variable = tree.PathVariable() + ":/usr/bin:/bin";
+    setenv("PATH", path_variable.c_str(), 1);
+
+    // The lines of the parser, realistic and adversarial
+    std::string quoted = "echo \"" + std::string(4096, 'q') + "\"";
+    std::string escaped = "echo";
+    for (int i = 0; i < 1000; i++)
+        escaped += " a\\ b\\\\";
+    std::string words = "echo";
+    for (int i = 0; i < 500; i++)
+        words += " word" + std::to_string(i);
+
+    CommandLine command_line;
+    auto        parse = [&](std::string_view line) {
+        return [&command_line, line]() {
+            keep(parseCommandLine(line, command_line));
+        };
+    };
+
+    std::vector<std::string> names_10k  = syntheticNames(10000);
+    std::vector<std::string> names_100k = syntheticNames(100000);
+    Trie                     tree_100k;
+    for (const std::string & name : names_100k)
+        tree_100k.Insert(name);
+
+    auto insert = [](const std::vector<std::string> & names) {
+        return [&names]() {
+            Trie trie;
+            for (const std::string & name : names)
+                trie.Insert(name);
+            keep(trie);
+        };
+    };
+
+    CommandTable warm_table("");
+    warm_table.Revalidate(path_variable);
+    warm_table.GetIndex();
+
+    // Each expansion reads its directories again, as a new line does
+    auto glob = [&](std::string pattern) {
+        return [pattern = tree.Root() + "/" + pattern]() {
+            GlobExpander                  expander;
+            std::string                   buffer;
+            std::vector<std::string_view> matches;
+            keep(expander.Expand(pattern, buffer, matches));
+        };
+    };
+
+    Shell shell;
+    shell.Complete("cm", 2, false); /* Build the completion tree */
+
+    std::string_view realistic =
+        "git log --oneline -n 20 | grep -v 'Merge branch' > /tmp/log.txt "
+        "&& echo \"done: $USER\" 2>&1";
+
+    std::vector<Benchmark> benchmarks = {
+        {"parse/realistic", 1, parse(realistic)},
+        {"parse/quoted-4k", 1, parse(quoted)},
+        {"parse/backslashes-2k", 1, parse(escaped)},
+        {"parse/words-500", 1, parse(words)},
+
+        {"trie/insert-10k (per name)", names_10k.size(), insert(names_10k)},
+        {"trie/insert-100k (per name)", names_100k.size(), insert(names_100k)},
+        {"trie/prefix-list-100k", 1,
+         [&]() { keep(tree_100k.FindPossibleStringByPrefix("cmd99")); }},
+        {"trie/common-prefix-100k", 1,
+         [&]() { keep(tree_100k.LongestCommonPrefix("x86_64-linux-gnu-g")); }},
+
+        {"table/scan-10k-cold", 1,
+         [&]() {
+             CommandTable table("");
+             table.Revalidate(path_variable);
+             keep(table.GetIndex().Size());
+         }},
+        {"table/find-hit", 1, [&]() { keep(warm_table.Find("cmd4321")); }},
+        {"table/find-miss", 1, [&]() { keep(warm_table.Find("nosuchcmd")); }},
+
+        {"glob/prefix-500", 1, glob("bin7/cmd37*")},
+        {"glob/star-10k", 1, glob("*/*[05]")},
+
+        {"complete/unique", 1, [&]() { keep(shell.Complete("cmd4321", 7, false)); }},
+        {"complete/list-100", 1,
+         [&]() { keep(shell.Complete("cmd12", 5, true)); }},
+
+        {"roundtrip/builtin", 1,
+         [&]() { keep(shell.ExecuteString("pwd > /dev/null")); }},
+        {"roundtrip/external", 1,
+         [&]() { keep(shell.ExecuteString("true")); }},
+
+        {"substitute/builtin", 1,
+         [&]() { keep(shell.ExecuteString("x=$(pwd)")); }},
+        {"substitute/external", 1,
+         [&]() { keep(shell.ExecuteString("x=$(true)")); }},
+    };
+
+    std::map<std::string, double> baseline;
+    if (!baseline_file.empty())
+        baseline = readBaseline(baseline_file);
+
+    std::ofstream written;
+    if (!write_file.empty())
+    {
+        written.open(write_file);
+        written << "# shell_bench baseline, nanoseconds per operation\n"
+                   "# Recorded from a Release build: "
+                   "cmake -DCMAKE_BUILD_TYPE=Release\n"
+                   "# Refresh with: shell_bench --write bench/baseline.txt\n";
+    }
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-32s %14s %14s %9s\n", "benchmark",
+                  "ns/op", "baseline", "change");
+    std::cout << line;
+
+    int status = 0;
+    for (const Benchmark & benchmark : benchmarks)
+    {
+        if (benchmark.name.find(filter) == std::string::npos)
+            continue;
+
+        double result = measure(benchmark);
+        if (written.is_open())
+        {
+            std::snprintf(line, sizeof(line), "%-32s %.1f\n",
+                          benchmark.name.c_str(), result);
+            written << line;
+        }
+
+        auto known = baseline.find(benchmark.name);
+        if (known == baseline.end())
+        {
+            std::snprintf(line, sizeof(line), "%-32s %14.1f %14s %9s\n",
+                          benchmark.name.c_str(), result, "-", "-");
+            std::cout << line << std::flush;
+            continue;
+        }
+
+        double change  = (result / known->second - 1) * 100;
+        bool   slower  = change > threshold;
+        status        |= slower;
+        std::snprintf(line, sizeof(line), "%-32s %14.1f %14.1f %+8.1f%%%s\n",
+                      benchmark.name.c_str(), result, known->second, change,
+                      slower ? "  REGRESSION" : "");
+        std::cout << line << std::flush;
+    }
+
+    return status;
+}
@@ -1,264 +1,854 @@
 #include "command.h"
+#include "parallel_runner.h"
 #include "shell.h"
-#include "tools.h"
+#include "tracer.h"
+#include <algorithm>
 #include <cctype>
+#include <charconv>
+#include <csignal>
+#include <cstring>
 #include <filesystem>
-#include <functional>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
-#include <sstream>
+#include <thread>
 
 namespace fs = std::filesystem;
 
-std::string commands::CommandBase::HandleSingleQuote(std::istringstream & iss)
+namespace
 {
-    std::string arg("\'"); /* Initialize with single quote sign */
-    char        ch;
+// The jobs `parallel -j 0` runs at once per core, mostly waiting on I/O
+constexpr size_t PARALLEL_JOBS_PER_CORE = 8;
+
+/**
+ *@brief Parse a whole argument as a number
+ *
+ * @return false if it is not a number
+ */
+bool parseNumber(std::string_view text, int & value)
+{
+    auto [end, error] =
+        std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc() && end == text.data() + text.size();
+}
+
+/**
+ *@brief Parse a signal given by number, or by name with or without `SIG`
+ *
+ * @return int the signal, -1 if there is none
+ */
+int parseSignal(std::string_view text)
+{
+    int number = 0;
+    if (parseNumber(text, number))
+        return number >= 0 && number < NSIG ? number : -1;
+
+    std::string name(text);
+    for (char & ch : name)
+        ch = static_cast<char>(std::toupper(static_cast<unsigned char>(ch)));
+    if (name.starts_with("SIG"))
+        name.erase(0, 3);
+
+    for (int signal = 1; signal < NSIG; signal++)
+        if (const char * abbreviation = sigabbrev_np(signal);
+            abbreviation && name == abbreviation)
+            return signal;
+
+    return -1;
+}
+
+/**
+ *@brief Find the job of a `%` spec, or of a pid
+ *
+ * @param context the builtin, to report the errors
+ * @param name the name of the builtin
+ * @param spec the argument
+ * @return Job * the job, nullptr after printing an error
+ */
+Job * findJob(const commands::ExecutionContext & context,
+              std::string_view name, std::string_view spec)
+{
+    JobTable & job_table = context.shell.GetJobTable();
+
+    Job * job = nullptr;
+    int   pid = 0;
+    if (spec.starts_with('%'))
+        job = job_table.Find(spec);
+    else if (parseNumber(spec, pid))
+        job = job_table.FindByPid(pid);
+
+    if (!job)
+        context.err << name << ": " << spec << ": no such job\n";
+
+    return job;
+}
+} // namespace
+
+int commands::Echo::Exec(const ExecutionContext & context)
+{
+    // Separate the arguments by spaces
+    for (size_t i = 0; i < context.arguments.size(); i++)
+        context.out << (i == 0 ? "" : " ") << context.arguments[i];
+
+    // Newline
+    context.out << '\n';
+
+    return 0;
+}
+
+int commands::Exit::Exec(const ExecutionContext & context)
+{
+    int exit_code = 0;
+
+    // Set the exit code
+    if (!context.arguments.empty())
+        exit_code = std::atoi(context.arguments[0].data());
+
+    // Exit the program, or only the subshell it runs in
+    exitProcess(exit_code);
+}
+
+int commands::Type::Exec(const ExecutionContext & context)
+{
+    if (context.arguments.empty())
+        return 0;
+
+    std::string_view cmd = context.arguments[0];
+
+    if (cmd == "time")
+    {
+        context.out << cmd << " is a shell keyword\n";
+        return 0;
+    }
+
+    if (!context.shell.CommandExist(cmd))
+    {
+        context.out << cmd << ": not found" << '\n';
+        return 1;
+    }
+
+    if (context.shell.IsBuiltin(cmd))
+        context.out << cmd << " is a shell builtin\n";
+    else
+        context.out << cmd << " is " << *context.shell.FindCommand(cmd)
+                    << '\n';
+
+    return 0;
+}
 
-    while (iss.get(ch))
+int commands::Pwd::Exec(const ExecutionContext & context)
+{
+    // The directory may have been removed under the shell
+    std::error_code error;
+    fs::path        path = fs::current_path(error);
+    if (error)
+    {
+        context.err << "pwd: " << error.message() << '\n';
+        return 1;
+    }
+
+    context.out << path.string() << '\n';
+    return 0;
+}
+
+int commands::Cd::Exec(const ExecutionContext & context)
+{
+    std::string home_path(
+        context.shell.GetVariables().Get("HOME").value_or(""));
+    std::string target_path;
+    if (context.arguments.empty())
     {
-        if (ch == '\'') /* Meet another single quote sign */
+        if (home_path.empty())
         {
-            // If the next character is also single quote sign, skip it
-            if (iss.peek() == '\'')
-                iss.get();
-            else /* The close single quote sign */
-            {
-                arg.push_back(ch);
-                break;
-            }
+            context.err << "cd: HOME not set\n";
+            return 1;
         }
-        else
-            // Treat all other characters as normal characters
-            arg.push_back(ch);
+        target_path = home_path;
+    }
+    else
+    {
+        target_path.assign(context.arguments[0]);
+        size_t home_sign_position = 0;
+        while ((home_sign_position = target_path.find("~")) !=
+               std::string::npos)
+            target_path.replace(home_sign_position, 1, home_path);
+    }
+
+    // A missing directory, a file or a denied one is an error, not an abort
+    std::error_code error;
+    fs::current_path(target_path, error);
+    if (error)
+    {
+        std::string_view shown =
+            context.arguments.empty() ? home_path : context.arguments[0];
+        context.out << "cd: " << shown << ": " << error.message() << '\n';
+        return 1;
     }
 
-    return arg;
+    return 0;
 }
 
-std::string commands::CommandBase::HandleDoubleQuote(std::istringstream & iss)
+int commands::Set::Exec(const ExecutionContext & context)
 {
-    std::string arg("\""); /* Initialize with double quote sign */
-    char        ch;
-    bool        in_double_quote = true;
+    // List the options
+    if (context.arguments.empty() ||
+        (context.arguments.size() == 1 &&
+         (context.arguments[0] == "-o" || context.arguments[0] == "+o")))
+    {
+        for (const auto & [name, value] : context.shell.GetOptions())
+            context.out << std::left << std::setw(15) << name
+                        << (value ? "on" : "off") << '\n';
+        return 0;
+    }
 
-    while (iss.get(ch))
+    std::string_view flag = context.arguments[0];
+    if (flag != "-o" && flag != "+o")
     {
-        if (ch == '\\') /* The character is backslash */
-            arg.push_back(HandleBackSlash(iss, in_double_quote));
-        else if (ch == '\"') /* Meet another double quote sign */
+        context.err << "set: " << flag << ": invalid option\n";
+        return 2;
+    }
+
+    // `-o` turns the options on and `+o` turns them off
+    for (std::string_view name : context.arguments.subspan(1))
+        if (!context.shell.SetOption(name, flag == "-o"))
         {
-            // The next character is also double quote sign, skip it
-            if (iss.peek() == '\"')
-                iss.get();
-            else if (std::isgraph(iss.peek()))
-            {
-                iss.get(ch);
-                arg.push_back(ch);
-                arg.erase(arg.begin());
-                in_double_quote = false;
-            }
-            else /* Meet the close double quote sign */
-            {
-                arg.push_back(ch);
-                break;
-            }
+            context.err << "set: " << name << ": invalid option name\n";
+            return 2;
         }
+
+    return 0;
+}
+
+int commands::Hash::Exec(const ExecutionContext & context)
+{
+    CommandTable & command_table = context.shell.GetCommandTable();
+
+    // List the remembered commands
+    if (context.arguments.empty())
+    {
+        bool empty = true;
+        for (const auto & [cmd, entry] : command_table.GetCache())
+        {
+            if (entry.path.empty())
+                continue;
+
+            if (empty)
+                context.out << "hits\tcommand\n";
+            empty = false;
+            context.out << std::right << std::setw(4) << entry.hits << '\t'
+                        << entry.path << '\n';
+        }
+
+        if (empty)
+            context.out << "hash: hash table empty\n";
+        return 0;
+    }
+
+    // Forget all remembered commands
+    if (context.arguments[0] == "-r")
+    {
+        command_table.Reset();
+        return 0;
+    }
+
+    // Show how long the last rebuild of the command index took
+    if (context.arguments[0] == "-s")
+    {
+        const CommandTable::ScanStatistics & statistics =
+            command_table.GetScanStatistics();
+
+        if (statistics.scans == 0)
+            context.out << "hash: PATH has not been scanned\n";
         else
-            arg.push_back(ch); /* Normal characters */
+            context.out << "scanned " << statistics.directories
+                        << " directories, reused " << statistics.reused
+                        << " (" << statistics.entries
+                        << " commands) in " << std::fixed
+                        << std::setprecision(3)
+                        << statistics.duration.count() / 1000.0 << " ms with "
+                        << statistics.threads << " threads"
+                        << (statistics.persisted ? "" : ", not saved") << '\n';
+        return 0;
     }
 
-    return arg;
+    // Look the commands up ahead of their use
+    int status = 0;
+    for (std::string_view cmd : context.arguments)
+        if (!context.shell.IsBuiltin(cmd) && !command_table.Find(cmd))
+        {
+            context.err << "hash: " << cmd << ": not found\n";
+            status = 1;
+        }
+
+    return status;
 }
 
-char commands::CommandBase::HandleBackSlash(std::istringstream & iss,
-                                            bool in_double_quote)
+int commands::History::Exec(const ExecutionContext & context)
 {
-    // Special characters for in double quote mode
-    static const std::string SPECIAL_CHARACTERS = "\\$\"";
-    char                     result             = 0;
+    ::History & history = context.shell.GetHistory();
 
-    if (in_double_quote) /* In double quote mode */
+    // Forget the entries of this shell
+    if (!context.arguments.empty() && context.arguments[0] == "-c")
     {
-        // The next character is the special character and store it in result
-        if (SPECIAL_CHARACTERS.find(result = (iss.peek())) != std::string::npos)
-            // Pop up the special character from the buffer of iss
-            iss.get();
-        else /* If it is not special character */
+        history.Clear();
+        return 0;
+    }
+
+    // Only list the last entries
+    size_t count = history.Size();
+    if (!context.arguments.empty())
+    {
+        std::string_view argument = context.arguments[0];
+        auto [end, error]         = std::from_chars(
+            argument.data(), argument.data() + argument.size(), count);
+        if (error != std::errc() || end != argument.data() + argument.size())
         {
-            iss.unget();     /* Step back to the backslash position */
-            iss.get(result); /* Re-get the backslash */
+            context.err << "history: " << argument
+                        << ": numeric argument required\n";
+            return 1;
         }
     }
-    else                 /* Not in the double quote signs */
-        iss.get(result); /* Get the next character and return */
 
-    return result;
+    for (size_t i = history.Size() - std::min(count, history.Size());
+         i < history.Size(); i++)
+        context.out << std::right << std::setw(5) << i + 1 << "  "
+                    << history.Entry(i) << '\n';
+
+    return 0;
 }
 
-std::pair<int, std::string>
-commands::CommandBase::SetArguments(const std::string & command_line)
+int commands::Jobs::Exec(const ExecutionContext & context)
 {
-    // Declare the type of quote signs
-    enum QUOTE_TYPE { NONE, SINGLE, DOUBLE };
+    JobTable & job_table = context.shell.GetJobTable();
+    job_table.Reap();
 
-    // String to judge quote signs
-    static const std::string QUOTE_SIGNS = "\'\"";
+    bool with_pids = false, only_pids = false;
+    auto specs     = context.arguments;
+    while (!specs.empty() && specs[0].starts_with('-') && specs[0].size() > 1)
+    {
+        if (specs[0] == "-l")
+            with_pids = true;
+        else if (specs[0] == "-p")
+            only_pids = true;
+        else
+        {
+            context.err << "jobs: " << specs[0] << ": invalid option\n";
+            return 2;
+        }
+        specs = specs.subspan(1);
+    }
+
+    std::vector<Job *> listed;
+    if (specs.empty())
+        for (auto & [id, job] : job_table.GetJobs())
+            listed.push_back(&job);
+    for (std::string_view spec : specs)
+        if (Job * job = findJob(context, "jobs", spec))
+            listed.push_back(job);
+        else
+            return 1;
+
+    for (Job * job : listed)
+        if (only_pids)
+            context.out << job->processes.front().pid << '\n';
+        else
+            job_table.Print(context.out, *job, with_pids);
+
+    // The done jobs are reported now, so they are forgotten
+    for (Job * job : listed)
+        if (job->State() == PROCESS_STATE::DONE)
+            job_table.Remove(job->id);
+        else
+            job->changed = false;
+
+    return 0;
+}
+
+int commands::Fg::Exec(const ExecutionContext & context)
+{
+    JobTable & job_table = context.shell.GetJobTable();
+    if (!job_table.HasJobControl())
+    {
+        context.err << "fg: no job control\n";
+        return 1;
+    }
 
-    // Use lambda expression to get the type of quote sign
-    std::function<int(char)> getQuoteType = [&](char ch) {
-        return ch == '\"' ? QUOTE_TYPE::DOUBLE : QUOTE_TYPE::SINGLE;
-    };
+    Job * job = findJob(context, "fg", context.arguments.empty()
+                                           ? "%+"
+                                           : context.arguments[0]);
+    if (!job)
+        return 1;
 
-    std::istringstream iss(command_line);
-    std::string        arg; /* Store the current arguments */
-    char               ch;
-    int                quote_type = QUOTE_TYPE::NONE;
+    context.out << job->command << '\n';
+    context.out.flush();
+
+    return context.shell.ContinueForeground(*job);
+}
 
-    // Ignore the invisible characters at the beginning of the buffer
-    while (iss.get(ch) && !std::isgraph(ch));
+int commands::Bg::Exec(const ExecutionContext & context)
+{
+    JobTable & job_table = context.shell.GetJobTable();
+    if (!job_table.HasJobControl())
+    {
+        context.err << "bg: no job control\n";
+        return 1;
+    }
 
-    // Step back to the first visible character
-    iss.unget();
-    arguments.clear(); /* Reset the list of arguments */
+    std::span<const std::string_view> specs = context.arguments;
+    std::string_view                  current[] = {"%+"};
+    if (specs.empty())
+        specs = current;
 
-    while (iss.get(ch))
+    int status = 0;
+    for (std::string_view spec : specs)
     {
-        if (!std::isgraph(ch)) /* If the character is invisible */
+        Job * job = findJob(context, "bg", spec);
+        if (!job)
         {
-            if (!arg.empty())             /* If the arg is not empty */
-                arguments.push_back(arg); /* Add the argument */
-            arg.clear();                  /* Reset the argument */
-            continue;                     /* Skip */
+            status = 1;
+            continue;
         }
 
-        // The current character is quote sign
-        if (QUOTE_SIGNS.find(ch) != std::string::npos)
-            arguments.push_back(getQuoteType(ch) == QUOTE_TYPE::SINGLE
-                                    ? HandleSingleQuote(iss)
-                                    : HandleDoubleQuote(iss));
-        else if (ch == '\\') /* The character is backslash */
-            arg.push_back(HandleBackSlash(iss, false));
-        else /* Common characters */
-            arg.push_back(ch);
+        if (job->State() == PROCESS_STATE::RUNNING)
+        {
+            context.err << "bg: job " << job->id
+                        << " already in background\n";
+            continue;
+        }
+
+        job_table.Background(*job);
+        context.out << '[' << job->id << "] " << job->command << " &\n";
     }
 
-    // Push the last argument into the list of arguments
-    if (!arg.empty())
-        arguments.push_back(arg);
+    return status;
+}
 
-    // Determine the type of redirection and remove the redirect path
-    const static std::string REDIRECT_SIGNS = "> 1> >> 1>> 2> 2>>";
-    int                      redirect_type  = REDIRECT_TYPE::STDOUT;
+int commands::Wait::Exec(const ExecutionContext & context)
+{
+    JobTable & job_table = context.shell.GetJobTable();
 
-    // File path to redirect
-    std::string                        redirect_to("");
-    std::vector<std::string>::iterator iter = arguments.begin();
+    // Wait for every job, the status is then 0
+    if (context.arguments.empty())
+    {
+        std::vector<int> ids;
+        for (auto & [id, job] : job_table.GetJobs())
+            ids.push_back(id);
 
-    // Find the redirect sign
-    for (; iter != arguments.end(); iter++)
-        if (REDIRECT_SIGNS.find(*iter) != std::string::npos)
+        for (int id : ids)
         {
-            if (*iter == ">" || *iter == "1>")
-                redirect_type = REDIRECT_TYPE::STDOUT_TO_FILE;
-            else if (*iter == ">>" || *iter == "1>>")
-                redirect_type = REDIRECT_TYPE::APPEND_STDOUT_TO_FILE;
-            else if (*iter == "2>")
-                redirect_type = REDIRECT_TYPE::STDERR_TO_FILE;
-            else if (*iter == "2>>")
-                redirect_type = REDIRECT_TYPE::APPEND_STDERR_TO_FILE;
-            else
-                continue;
+            auto iter = job_table.GetJobs().find(id);
+            if (iter != job_table.GetJobs().end() &&
+                job_table.Wait(iter->second))
+                job_table.Remove(id);
+        }
+        return 0;
+    }
 
-            break;
+    int status = 0;
+    for (std::string_view spec : context.arguments)
+    {
+        int   pid = 0;
+        Job * job = spec.starts_with('%') ? job_table.Find(spec)
+                    : parseNumber(spec, pid) ? job_table.FindByPid(pid)
+                                             : nullptr;
+        if (!job)
+        {
+            context.err << "wait: " << spec
+                        << (spec.starts_with('%')
+                                ? ": no such job\n"
+                                : ": not a child of this shell\n");
+            status = 127;
+            continue;
         }
 
-    // Set the redirect path
-    if (redirect_type != REDIRECT_TYPE::STDOUT)
-        redirect_to = *(iter + 1);
+        bool done = job_table.Wait(*job);
+
+        // A pid gives the status of that process, a job of its last one
+        status = job->Status();
+        for (const Job::Process & process : job->processes)
+            if (process.pid == pid)
+                status = process.status;
 
-    // Remove the arguments after the redirect sign
-    arguments.erase(iter, arguments.end());
+        if (done)
+            job_table.Remove(job->id);
+    }
 
-    return {redirect_type, redirect_to};
+    return status;
 }
 
-void commands::Echo::Exec(std::shared_ptr<Shell> sh)
+int commands::Kill::Exec(const ExecutionContext & context)
 {
-    // Set arguments at first
-    SetArguments(sh->GetInputLine());
+    JobTable & job_table = context.shell.GetJobTable();
+    auto       arguments = context.arguments;
+    int        signal    = SIGTERM;
 
-    // Traverse the arguments list
-    for (std::string arg : GetArguments())
-        std::cout << removeQuoteSigns(arg) << ' ';
+    if (arguments.empty())
+    {
+        context.err << "kill: usage: kill [-s sigspec | -n signum | -sigspec] "
+                       "pid | jobspec ... or kill -l [sigspec]\n";
+        return 2;
+    }
 
-    // Newline
-    std::cout << '\n';
+    // List the signals, or name the ones given, a status as well
+    if (arguments[0] == "-l")
+    {
+        if (arguments.size() == 1)
+        {
+            for (int number = 1; number < SIGRTMIN; number++)
+                if (const char * name = sigabbrev_np(number))
+                    context.out << std::right << std::setw(2) << number << ") SIG"
+                                << std::left << std::setw(8) << name
+                                << (number % 5 == 0 ? "\n" : "\t");
+            context.out << '\n';
+            return 0;
+        }
 
-    return;
-}
+        int status = 0;
+        for (std::string_view argument : arguments.subspan(1))
+        {
+            int          number = 0;
+            const char * name   = nullptr;
+            if (parseNumber(argument, number))
+            {
+                // An exit status names the signal that killed
+                if (number > 128)
+                    number -= 128;
+                if (number > 0 && number < NSIG)
+                    name = sigabbrev_np(number);
+                if (name)
+                    context.out << name << '\n';
+            }
+            else if ((number = parseSignal(argument)) > 0)
+            {
+                name = argument.data();
+                context.out << number << '\n';
+            }
 
-void commands::Exit::Exec(std::shared_ptr<Shell> sh)
-{
-    SetArguments(sh->GetInputLine());
+            if (!name)
+            {
+                context.err << "kill: " << argument
+                            << ": invalid signal specification\n";
+                status = 1;
+            }
+        }
+        return status;
+    }
 
-    int exit_code = 0;
+    // The signal is `-s name`, `-n number` or `-name`
+    if (arguments[0] == "-s" || arguments[0] == "-n")
+    {
+        if (arguments.size() < 2 || (signal = parseSignal(arguments[1])) < 0)
+        {
+            context.err << "kill: "
+                        << (arguments.size() < 2 ? arguments[0] : arguments[1])
+                        << ": invalid signal specification\n";
+            return 1;
+        }
+        arguments = arguments.subspan(2);
+    }
+    else if (arguments[0] == "--")
+        arguments = arguments.subspan(1);
+    else if (arguments[0].starts_with('-') && arguments[0].size() > 1)
+    {
+        if ((signal = parseSignal(arguments[0].substr(1))) < 0)
+        {
+            context.err << "kill: " << arguments[0].substr(1)
+                        << ": invalid signal specification\n";
+            return 1;
+        }
+        arguments = arguments.subspan(1);
+    }
 
-    // Set the exit code
-    if (!GetArguments().empty())
-        exit_code = std::atoi(GetArguments()[0].c_str());
+    if (!arguments.empty() && arguments[0] == "--")
+        arguments = arguments.subspan(1);
 
-    // Exit the program
-    std::exit(exit_code);
+    int status = 0;
+    for (std::string_view target : arguments)
+    {
+        int pid = 0;
+        if (target.starts_with('%'))
+        {
+            Job * job = findJob(context, "kill", target);
+            if (!job)
+            {
+                status = 1;
+                continue;
+            }
+
+            // A stopped job only gets the signal once it continues
+            bool sent = job_table.Signal(*job, signal);
+            if (sent && job->State() == PROCESS_STATE::STOPPED &&
+                signal != SIGSTOP && signal != SIGTSTP && signal != SIGCONT &&
+                signal != 0)
+                job_table.Signal(*job, SIGCONT);
+            if (!sent)
+            {
+                context.err << "kill: " << target << ": "
+                            << std::strerror(errno) << '\n';
+                status = 1;
+            }
+        }
+        else if (!parseNumber(target, pid))
+        {
+            context.err << "kill: " << target
+                        << ": arguments must be process or job IDs\n";
+            status = 1;
+        }
+        else if (kill(pid, signal) == -1)
+        {
+            context.err << "kill: (" << pid << ") - " << std::strerror(errno)
+                        << '\n';
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+bool commands::Parallel::ReadsInput(
+    std::span<const std::string_view> arguments) const
+{
+    return std::find(arguments.begin(), arguments.end(), ":::") ==
+           arguments.end();
 }
 
-void commands::Type::Exec(std::shared_ptr<Shell> sh)
+int commands::Parallel::Exec(const ExecutionContext & context)
 {
-    SetArguments(sh->GetInputLine());
+    size_t cores        = std::max(1u, std::thread::hardware_concurrency());
+    size_t worker_count = cores;
+    bool   ordered      = false;
+    auto   arguments    = context.arguments;
 
-    std::unordered_map<std::string, std::string> command_list =
-        sh->GetCommandList();
-    std::string cmd = GetArguments()[0];
+    while (!arguments.empty() && arguments[0].starts_with('-'))
+    {
+        std::string_view option = arguments[0];
+        arguments               = arguments.subspan(1);
+        if (option == "--")
+            break;
+        if (option == "-k")
+        {
+            ordered = true;
+            continue;
+        }
 
-    if (!sh->CommandExist(cmd))
-        std::cout << cmd << ": not found" << '\n';
+        // `-j N` or `-jN`, 0 runs as many jobs as the pool allows
+        int count = -1;
+        if (option == "-j" && !arguments.empty())
+        {
+            parseNumber(arguments[0], count);
+            arguments = arguments.subspan(1);
+        }
+        else if (option.starts_with("-j"))
+            parseNumber(option.substr(2), count);
+        else
+        {
+            context.err << "parallel: " << option << ": invalid option\n";
+            return 2;
+        }
+
+        if (count < 0)
+        {
+            context.err << "parallel: -j: a number of jobs is required\n";
+            return 2;
+        }
+        worker_count = count == 0 ? cores * PARALLEL_JOBS_PER_CORE : count;
+    }
+
+    auto separator = std::find(arguments.begin(), arguments.end(), ":::");
+    std::span<const std::string_view> command(arguments.begin(), separator);
+    if (command.empty())
+    {
+        context.err << "parallel: usage: parallel [-j N] [-k] command "
+                       "[args...] [::: inputs...]\n";
+        return 2;
+    }
+
+    // The inputs follow `:::`, or are the lines of stdin
+    std::vector<std::string> inputs;
+    if (separator != arguments.end())
+        inputs.assign(separator + 1, arguments.end());
     else
-        std::cout << cmd << " is "
-                  << (sh->IsBuiltin(cmd) ? "a shell builtin"
-                                         : command_list[cmd])
-                  << '\n';
+        for (std::string line; std::getline(context.in, line);)
+            inputs.push_back(std::move(line));
+    context.in.clear();
+
+    // Resolved once for every job; a builtin runs as the program of its name
+    std::string_view name = command[0];
+    std::string      path(name);
+    if (name.find('/') == std::string_view::npos)
+    {
+        const std::string * found =
+            context.shell.GetCommandTable().Find(name, true);
+        if (!found)
+        {
+            context.err << "parallel: " << name << ": command not found\n";
+            return 127;
+        }
+        path = *found;
+    }
 
-    return;
+    // Each input replaces `{}`, or is the last argument without one
+    std::vector<ParallelJob> jobs(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        bool replaced = false;
+        for (std::string_view word : command)
+        {
+            std::string argument(word);
+            for (size_t at = 0;
+                 (at = argument.find("{}", at)) != std::string::npos;
+                 at += inputs[i].size())
+            {
+                argument.replace(at, 2, inputs[i]);
+                replaced = true;
+            }
+            jobs[i].arguments.push_back(std::move(argument));
+        }
+        if (!replaced)
+            jobs[i].arguments.push_back(inputs[i]);
+    }
+    if (jobs.empty())
+        return 0;
+
+    context.out.flush();
+    context.err.flush();
+
+    ParallelRunner runner(path, context.shell.GetVariables().GetEnvironment(),
+                          jobs);
+    size_t         failed =
+        runner.RunAll(worker_count, ordered, [&](ParallelJob & job) {
+            context.out << job.output;
+            context.err << job.errors;
+            context.out.flush();
+            context.err.flush();
+        });
+
+    // The status counts the failed jobs, 101 for more than 100
+    return static_cast<int>(std::min<size_t>(failed, 101));
 }
 
-void commands::Pwd::Exec(std::shared_ptr<Shell> sh)
+int commands::Stats::Exec(const ExecutionContext & context)
 {
-    SetArguments(sh->GetInputLine());
+    if (context.arguments.empty())
+    {
+        if (!Tracer::Enabled())
+            context.err << "stats: tracing is off, turn it on with "
+                           "`set -o trace`\n";
+        Tracer::PrintStatistics(context.out);
+        return 0;
+    }
+
+    std::string_view option = context.arguments[0];
+    if (option == "-r")
+    {
+        Tracer::Reset();
+        return 0;
+    }
 
-    std::cout << fs::current_path().string() << '\n';
-    return;
+    // Export the spans, `-` writes them to stdout
+    if (option == "-t" && context.arguments.size() == 2)
+    {
+        std::string_view file = context.arguments[1];
+        if (file == "-")
+        {
+            Tracer::ExportChromeTrace(context.out);
+            return 0;
+        }
+
+        std::ofstream out{std::string(file)};
+        if (out)
+            Tracer::ExportChromeTrace(out);
+        if (!out)
+        {
+            context.err << "stats: " << file << ": cannot write the trace\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    context.err << "stats: usage: stats [-r | -t file]\n";
+    return 2;
 }
 
-void commands::Cd::Exec(std::shared_ptr<Shell> sh)
+int commands::Export::Exec(const ExecutionContext & context)
 {
-    SetArguments(sh->GetInputLine());
+    VariableStore &                   variables = context.shell.GetVariables();
+    std::span<const std::string_view> names     = context.arguments;
+    bool                              exported  = true;
 
-    std::string home_path = sh->GetEnvironmentVariable("HOME");
-    if (GetArguments().empty())
+    if (names.size() == 1 && names[0] == "-p")
+        names = {};
+    else if (!names.empty() && names[0] == "-n")
+    {
+        exported = false;
+        names    = names.subspan(1);
+    }
+    else if (!names.empty() && names[0].starts_with('-'))
     {
-        fs::current_path(home_path);
-        return;
+        context.err << "export: usage: export [-n] [name[=value] ...]\n";
+        return 2;
     }
 
-    std::string target_path        = GetArguments()[0];
-    size_t      home_sign_position = 0;
-    while ((home_sign_position = target_path.find("~")) != std::string::npos)
-        target_path.replace(home_sign_position, 1, home_path);
+    // List them in a form the shell reads back
+    if (names.empty() && exported)
+    {
+        for (const auto & [name, value] : variables.Exported())
+        {
+            context.out << "export " << name;
+            if (value)
+            {
+                context.out << "=\"";
+                for (char ch : *value)
+                {
+                    if (std::string_view("\\$\"`").find(ch) !=
+                        std::string_view::npos)
+                        context.out << '\\';
+                    context.out << ch;
+                }
+                context.out << '"';
+            }
+            context.out << '\n';
+        }
+        return 0;
+    }
 
-    if (!fs::exists(target_path))
-        std::cout << "cd: " << GetArguments()[0]
-                  << ": No such file or directory\n";
-    else
-        fs::current_path(target_path);
+    int status = 0;
+    for (std::string_view word : names)
+    {
+        size_t           equal = word.find('=');
+        std::string_view name  = word.substr(0, equal);
+        if (!VariableStore::IsName(name))
+        {
+            context.err << "export: `" << word << "': not a valid identifier\n";
+            status = 1;
+            continue;
+        }
+
+        if (equal != std::string_view::npos)
+            variables.Set(name, word.substr(equal + 1));
+        variables.Export(name, exported);
+    }
+
+    return status;
+}
+
+int commands::Unset::Exec(const ExecutionContext & context)
+{
+    std::span<const std::string_view> names = context.arguments;
+    if (!names.empty() && names[0] == "-v")
+        names = names.subspan(1);
+
+    int status = 0;
+    for (std::string_view name : names)
+    {
+        if (!VariableStore::IsName(name))
+        {
+            context.err << "unset: `" << name << "': not a valid identifier\n";
+            status = 1;
+            continue;
+        }
+        context.shell.GetVariables().Unset(name);
+    }
 
-    return;
+    return status;
 }
@@ -1,53 +1,65 @@
 #ifndef _COMMAND_H_
 #define _COMMAND_H_
 
-#include <memory>
-#include <sstream>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <span>
 #include <string>
-#include <vector>
+#include <string_view>
 
 #define COMMANDS_NAMESPACE_BEGIN \
     namespace commands           \
     {
 #define COMMANDS_NAMESPACE_END }
 
-enum REDIRECT_TYPE {
-    STDOUT,
-    STDOUT_TO_FILE,
-    APPEND_STDOUT_TO_FILE,
-    STDERR_TO_FILE,
-    APPEND_STDERR_TO_FILE
-};
-
 class Shell;
 
 COMMANDS_NAMESPACE_BEGIN
 
-class CommandBase
+/**
+ *@brief The context a builtin command is executed in
+ *
+ * It only refers to data owned by the caller, so passing it to `Exec()` does
+ * not copy the shell or allocate anything.
+ */
+struct ExecutionContext
 {
-private:
-    std::vector<std::string> arguments;
-
-    // Handle special characters during `SetArguments()`
-    std::string HandleSingleQuote(std::istringstream & iss);
-    std::string HandleDoubleQuote(std::istringstream & iss);
-    char        HandleBackSlash(std::istringstream & iss, bool in_double_quote);
+    Shell &                             shell;     /* The running shell */
+    std::span<const std::string_view> arguments; /* Without the command */
+    std::istream &                      in;
+    std::ostream &                      out;
+    std::ostream &                      err;
+};
 
+class CommandBase
+{
 public:
-    CommandBase() {}
+    constexpr CommandBase() {}
     ~CommandBase() {}
 
     /**
-     *@brief Set the arguments vector
+     *@brief Execute the command
      *
-     * @param command_line the line of arguments
-     * @return the redirect type
+     * @param context the pre-parsed arguments and the stdio handles
+     * @return int the exit status
      */
-    std::pair<int, std::string> SetArguments(const std::string & command_line);
+    virtual int Exec(const ExecutionContext &) { return 0; }
 
-    const std::vector<std::string> & GetArguments() const { return arguments; }
+    /**
+     *@brief Check whether the command only prints and never changes the
+     * shell, so a substitution can run it in place of a subshell
+     */
+    virtual bool IsReadOnly() const { return false; }
 
-    virtual void Exec(std::shared_ptr<Shell>) {}
+    /**
+     *@brief Check whether the command reads its stdin with these arguments,
+     * so it must be forked to read the terminal or the rest of the script
+     */
+    virtual bool ReadsInput(std::span<const std::string_view>) const
+    {
+        return false;
+    }
 };
 
 class Echo : public CommandBase
@@ -55,7 +67,8 @@ class Echo : public CommandBase
 public:
     Echo() = default;
 
-    void Exec(std::shared_ptr<Shell> sh) override;
+    int  Exec(const ExecutionContext & context) override;
+    bool IsReadOnly() const override { return true; }
 };
 
 class Exit : public CommandBase
@@ -63,7 +76,7 @@ class Exit : public CommandBase
 public:
     Exit() = default;
 
-    void Exec(std::shared_ptr<Shell> sh) override;
+    int Exec(const ExecutionContext & context) override;
 };
 
 class Type : public CommandBase
@@ -71,7 +84,8 @@ class Type : public CommandBase
 public:
     Type() = default;
 
-    void Exec(std::shared_ptr<Shell> sh) override;
+    int  Exec(const ExecutionContext & context) override;
+    bool IsReadOnly() const override { return true; }
 };
 
 class Pwd : public CommandBase
@@ -79,7 +93,8 @@ class Pwd : public CommandBase
 public:
     Pwd() = default;
 
-    void Exec(std::shared_ptr<Shell> sh) override;
+    int  Exec(const ExecutionContext & context) override;
+    bool IsReadOnly() const override { return true; }
 };
 
 class Cd : public CommandBase
@@ -87,9 +102,246 @@ class Cd : public CommandBase
 public:
     Cd() = default;
 
-    void Exec(std::shared_ptr<Shell> sh) override;
+    int Exec(const ExecutionContext & context) override;
+};
+
+class Set : public CommandBase
+{
+public:
+    Set() = default;
+
+    int Exec(const ExecutionContext & context) override;
+};
+
+class Hash : public CommandBase
+{
+public:
+    Hash() = default;
+
+    int Exec(const ExecutionContext & context) override;
+};
+
+class History : public CommandBase
+{
+public:
+    History() = default;
+
+    int Exec(const ExecutionContext & context) override;
+};
+
+class Jobs : public CommandBase
+{
+public:
+    Jobs() = default;
+
+    int Exec(const ExecutionContext & context) override;
+};
+
+class Fg : public CommandBase
+{
+public:
+    Fg() = default;
+
+    int Exec(const ExecutionContext & context) override;
+};
+
+class Bg : public CommandBase
+{
+public:
+    Bg() = default;
+
+    int Exec(const ExecutionContext & context) override;
+};
+
+class Wait : public CommandBase
+{
+public:
+    Wait() = default;
+
+    int Exec(const ExecutionContext & context) override;
 };
 
+class Kill : public CommandBase
+{
+public:
+    Kill() = default;
+
+    int Exec(const ExecutionContext & context) override;
+};
+
+/**
+ *@brief Run a program once per argument, several at a time
+ *
+ * `parallel [-j N] [-k] command [args...] [::: inputs...]` runs the command
+ * with each input in place of `{}`, or after its arguments, and reads the
+ * inputs from stdin, one per line, when there is no `:::`. `-j 0` runs 8
+ * jobs per core at once.
+ */
+class Parallel : public CommandBase
+{
+public:
+    Parallel() = default;
+
+    int  Exec(const ExecutionContext & context) override;
+    bool ReadsInput(std::span<const std::string_view> arguments) const override;
+};
+
+/**
+ *@brief Show the latencies recorded by the tracer
+ *
+ * `stats` prints the percentiles of each phase, `stats -r` forgets them and
+ * `stats -t file` writes the recent spans as a Chrome trace.
+ */
+class Stats : public CommandBase
+{
+public:
+    Stats() = default;
+
+    int Exec(const ExecutionContext & context) override;
+};
+
+/**
+ *@brief Export variables to the environment of the programs
+ *
+ * `export NAME[=value]...` exports the variables, `export -n NAME...` stops
+ * exporting them and `export` or `export -p` lists the exported ones.
+ */
+class Export : public CommandBase
+{
+public:
+    Export() = default;
+
+    int Exec(const ExecutionContext & context) override;
+};
+
+/**
+ *@brief Remove variables
+ */
+class Unset : public CommandBase
+{
+public:
+    Unset() = default;
+
+    int Exec(const ExecutionContext & context) override;
+};
+
+/**
+ * The builtins are statically allocated and found through a perfect hash
+ * computed at compile time, so resolving one allocates nothing and costs a
+ * hash of the name and a single comparison.
+ */
+inline constinit Echo    echo_command;
+inline constinit Exit    exit_command;
+inline constinit Type    type_command;
+inline constinit Pwd     pwd_command;
+inline constinit Cd      cd_command;
+inline constinit Set     set_command;
+inline constinit Hash    hash_command;
+inline constinit History history_command;
+inline constinit Jobs    jobs_command;
+inline constinit Fg      fg_command;
+inline constinit Bg      bg_command;
+inline constinit Wait    wait_command;
+inline constinit Kill    kill_command;
+inline constinit Parallel parallel_command;
+inline constinit Stats   stats_command;
+inline constinit Export  export_command;
+inline constinit Unset   unset_command;
+
+struct Builtin
+{
+    std::string_view name;
+    CommandBase *    command;
+};
+
+inline constexpr std::array BUILTINS = {
+    Builtin{"echo", &echo_command}, Builtin{"exit", &exit_command},
+    Builtin{"type", &type_command}, Builtin{"pwd", &pwd_command},
+    Builtin{"cd", &cd_command},     Builtin{"set", &set_command},
+    Builtin{"hash", &hash_command}, Builtin{"history", &history_command},
+    Builtin{"jobs", &jobs_command}, Builtin{"fg", &fg_command},
+    Builtin{"bg", &bg_command},     Builtin{"wait", &wait_command},
+    Builtin{"kill", &kill_command}, Builtin{"parallel", &parallel_command},
+    Builtin{"stats", &stats_command}, Builtin{"export", &export_command},
+    Builtin{"unset", &unset_command},
+};
+
+// The number of slots of the hash table, a power of two
+inline constexpr size_t BUILTIN_SLOTS = [] {
+    size_t slots = 1;
+    while (slots < BUILTINS.size() * 4) slots *= 2;
+    return slots;
+}();
+
+/**
+ *@brief Hash a name into a slot of the builtin table
+ *
+ * @param name the name of the command
+ * @param seed the seed found by `findBuiltinSeed()`
+ * @return size_t the slot
+ */
+constexpr size_t hashBuiltin(std::string_view name, uint32_t seed)
+{
+    uint32_t hash = seed;
+    for (char ch : name) hash = (hash ^ static_cast<uint8_t>(ch)) * 16777619u;
+
+    return (hash ^ (hash >> 16)) & (BUILTIN_SLOTS - 1);
+}
+
+/**
+ *@brief Find the first seed for which no two builtins share a slot
+ *
+ * @return uint32_t the seed, 0 if there is none
+ */
+constexpr uint32_t findBuiltinSeed()
+{
+    for (uint32_t seed = 1; seed < 100000; seed++)
+    {
+        std::array<bool, BUILTIN_SLOTS> used = {};
+        bool                            collision = false;
+
+        for (const Builtin & builtin : BUILTINS)
+        {
+            size_t slot = hashBuiltin(builtin.name, seed);
+            collision   = collision || used[slot];
+            used[slot]  = true;
+        }
+
+        if (!collision)
+            return seed;
+    }
+
+    return 0;
+}
+
+inline constexpr uint32_t BUILTIN_SEED = findBuiltinSeed();
+static_assert(BUILTIN_SEED != 0, "the builtin names have no perfect hash");
+
+// The index of the builtin in `BUILTINS` for each slot, -1 if it is empty
+inline constexpr std::array<int8_t, BUILTIN_SLOTS> BUILTIN_TABLE = [] {
+    std::array<int8_t, BUILTIN_SLOTS> table = {};
+    table.fill(-1);
+    for (size_t i = 0; i < BUILTINS.size(); i++)
+        table[hashBuiltin(BUILTINS[i].name, BUILTIN_SEED)] =
+            static_cast<int8_t>(i);
+    return table;
+}();
+
+/**
+ *@brief Find a builtin command
+ *
+ * @param name the name of the command
+ * @return CommandBase * the command, or nullptr if it is not a builtin
+ */
+constexpr CommandBase * findBuiltin(std::string_view name)
+{
+    int8_t index = BUILTIN_TABLE[hashBuiltin(name, BUILTIN_SEED)];
+    if (index == -1 || BUILTINS[index].name != name)
+        return nullptr;
+
+    return BUILTINS[index].command;
+}
+
 COMMANDS_NAMESPACE_END
 
 #endif // !_COMMAND_H_
\ No newline at end of file
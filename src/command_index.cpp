@@ -0,0 +1,297 @@
+#include "command_index.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+bool CommandIndex::Attach()
+{
+    header = nullptr;
+    if (size < sizeof(Header))
+        return false;
+
+    const auto * candidate = reinterpret_cast<const Header *>(data);
+    if (std::memcmp(candidate->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        candidate->version != VERSION)
+        return false;
+
+    // The tables follow each other, check that they fit in the file
+    size_t directories_offset = sizeof(Header);
+    size_t entries_offset =
+        directories_offset +
+        size_t(candidate->directory_count) * sizeof(DirectoryRecord);
+    size_t lookup_offset =
+        entries_offset + size_t(candidate->entry_count) * sizeof(EntryRecord);
+    size_t strings_offset =
+        lookup_offset + size_t(candidate->lookup_count) * sizeof(uint32_t);
+
+    if (strings_offset + candidate->strings_size != size)
+        return false;
+
+    directories = reinterpret_cast<const DirectoryRecord *>(
+        data + directories_offset);
+    entries = reinterpret_cast<const EntryRecord *>(data + entries_offset);
+    lookup  = reinterpret_cast<const uint32_t *>(data + lookup_offset);
+    strings = data + strings_offset;
+
+    // A corrupted index must not make a lookup read outside of it
+    auto inStrings = [&](uint32_t offset, uint32_t length) {
+        return size_t(offset) + length <= candidate->strings_size;
+    };
+    for (uint32_t i = 0; i < candidate->directory_count; i++)
+        if (!inStrings(directories[i].path_offset,
+                       directories[i].path_length) ||
+            size_t(directories[i].first_entry) + directories[i].entry_count >
+                candidate->entry_count)
+            return false;
+    for (uint32_t i = 0; i < candidate->entry_count; i++)
+        if (!inStrings(entries[i].name_offset, entries[i].name_length) ||
+            entries[i].directory >= candidate->directory_count)
+            return false;
+    for (uint32_t i = 0; i < candidate->lookup_count; i++)
+        if (lookup[i] >= candidate->entry_count)
+            return false;
+
+    header = candidate;
+
+    return true;
+}
+
+bool CommandIndex::Open(const std::string & file)
+{
+    Close();
+
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void * mapping =
+        mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); /* The mapping stays valid */
+
+    if (mapping == MAP_FAILED)
+        return false;
+
+    data   = static_cast<const char *>(mapping);
+    size   = status.st_size;
+    mapped = true;
+
+    if (!Attach())
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void CommandIndex::Assign(std::vector<char> && content)
+{
+    Close();
+
+    buffer = std::move(content);
+    data   = buffer.data();
+    size   = buffer.size();
+
+    if (!Attach())
+        Close();
+
+    return;
+}
+
+void CommandIndex::Close()
+{
+    if (mapped)
+        munmap(const_cast<char *>(data), size);
+
+    buffer.clear();
+    data   = nullptr;
+    size   = 0;
+    mapped = false;
+    header = nullptr;
+
+    return;
+}
+
+std::optional<size_t> CommandIndex::FindDirectory(std::string_view path) const
+{
+    for (size_t i = 0; i < DirectoryCount(); i++)
+        if (DirectoryPath(i) == path)
+            return i;
+
+    return std::nullopt;
+}
+
+bool CommandIndex::IsFresh(size_t directory, const timespec & mtime,
+                           bool exists) const
+{
+    const DirectoryRecord & record = directories[directory];
+
+    return (record.exists != 0) == exists &&
+           record.mtime_sec == mtime.tv_sec &&
+           record.mtime_nsec == mtime.tv_nsec;
+}
+
+std::vector<std::string> CommandIndex::DirectoryNames(size_t directory) const
+{
+    const DirectoryRecord &  record = directories[directory];
+    std::vector<std::string> names;
+
+    names.reserve(record.entry_count);
+    for (uint32_t i = 0; i < record.entry_count; i++)
+    {
+        const EntryRecord & entry = entries[record.first_entry + i];
+        names.emplace_back(String(entry.name_offset, entry.name_length));
+    }
+
+    return names;
+}
+
+size_t CommandIndex::LowerBound(std::string_view prefix) const
+{
+    size_t low = 0, high = Size();
+
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (Name(middle) < prefix)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+std::optional<size_t> CommandIndex::Find(std::string_view name) const
+{
+    size_t position = LowerBound(name);
+    if (position < Size() && Name(position) == name)
+        return position;
+
+    return std::nullopt;
+}
+
+std::vector<char>
+CommandIndex::Build(const std::vector<DirectoryListing> & listings)
+{
+    std::vector<DirectoryRecord> directory_records;
+    std::vector<EntryRecord>     entry_records;
+    std::string                  string_table;
+
+    auto addString = [&](std::string_view s) {
+        uint32_t offset = static_cast<uint32_t>(string_table.size());
+        string_table.append(s);
+        return offset;
+    };
+
+    for (const DirectoryListing & listing : listings)
+    {
+        DirectoryRecord record = {};
+        record.path_offset     = addString(listing.path);
+        record.path_length     = static_cast<uint32_t>(listing.path.size());
+        record.first_entry     = static_cast<uint32_t>(entry_records.size());
+        record.entry_count     = static_cast<uint32_t>(listing.names.size());
+        record.mtime_sec       = listing.mtime.tv_sec;
+        record.mtime_nsec      = listing.mtime.tv_nsec;
+        record.exists          = listing.exists;
+
+        for (const std::string & name : listing.names)
+            entry_records.push_back(
+                {addString(name), static_cast<uint32_t>(name.size()),
+                 static_cast<uint32_t>(directory_records.size())});
+
+        directory_records.push_back(record);
+    }
+
+    auto nameOf = [&](uint32_t i) {
+        return std::string_view(string_table)
+            .substr(entry_records[i].name_offset, entry_records[i].name_length);
+    };
+
+    /**
+     * Sort by name, the stable sort keeps PATH order among equal names,
+     * so the first of them is the command that wins
+     */
+    std::vector<uint32_t> lookup_table(entry_records.size());
+    for (uint32_t i = 0; i < lookup_table.size(); i++) lookup_table[i] = i;
+    std::stable_sort(
+        lookup_table.begin(), lookup_table.end(),
+        [&](uint32_t a, uint32_t b) { return nameOf(a) < nameOf(b); });
+    lookup_table.erase(
+        std::unique(
+            lookup_table.begin(), lookup_table.end(),
+            [&](uint32_t a, uint32_t b) { return nameOf(a) == nameOf(b); }),
+        lookup_table.end());
+
+    Header file_header = {};
+    std::memcpy(file_header.magic, MAGIC, sizeof(MAGIC));
+    file_header.version = VERSION;
+    file_header.directory_count =
+        static_cast<uint32_t>(directory_records.size());
+    file_header.entry_count  = static_cast<uint32_t>(entry_records.size());
+    file_header.lookup_count = static_cast<uint32_t>(lookup_table.size());
+    file_header.strings_size = static_cast<uint32_t>(string_table.size());
+
+    // Lay the tables out one after another
+    std::vector<char> content;
+    auto              append = [&](const void * source, size_t length) {
+        const char * bytes = static_cast<const char *>(source);
+        content.insert(content.end(), bytes, bytes + length);
+    };
+
+    append(&file_header, sizeof(file_header));
+    append(directory_records.data(),
+           directory_records.size() * sizeof(DirectoryRecord));
+    append(entry_records.data(), entry_records.size() * sizeof(EntryRecord));
+    append(lookup_table.data(), lookup_table.size() * sizeof(uint32_t));
+    append(string_table.data(), string_table.size());
+
+    return content;
+}
+
+bool CommandIndex::Write(const std::string &       file,
+                         const std::vector<char> & content)
+{
+    std::error_code error;
+    fs::create_directories(fs::path(file).parent_path(), error);
+
+    // Write a temporary file and rename it, readers never see a partial one
+    std::string temporary = file + ".tmp." + std::to_string(getpid());
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+    if (fd == -1)
+        return false;
+
+    size_t written = 0;
+    while (written < content.size())
+    {
+        ssize_t n =
+            write(fd, content.data() + written, content.size() - written);
+        if (n <= 0)
+            break;
+        written += n;
+    }
+    close(fd);
+
+    if (written != content.size() ||
+        rename(temporary.c_str(), file.c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
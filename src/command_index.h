@@ -0,0 +1,202 @@
+#ifndef _COMMAND_INDEX_H_
+#define _COMMAND_INDEX_H_
+
+#include <cstdint>
+#include <ctime>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ *@brief The listing of one PATH directory, used to build a `CommandIndex`
+ */
+struct DirectoryListing
+{
+    std::string              path;
+    timespec                 mtime  = {};
+    bool                     exists = false;
+    std::vector<std::string> names; /* The executables in it */
+};
+
+/**
+ *@brief A read-only, memory-mappable index of the commands in PATH
+ *
+ * The file holds the PATH directories with their modification times, the
+ * executables of each directory, and a table of the commands sorted by name
+ * where a command in an earlier directory shadows the later ones. Lookups
+ * and prefix enumeration run on the mapping itself; nothing is deserialized.
+ *
+ * Layout: header, directories, entries, sorted lookup table, strings.
+ */
+class CommandIndex
+{
+private:
+    static constexpr char     MAGIC[8] = {'S', 'H', 'C', 'M',
+                                          'D', 'I', 'D', 'X'};
+    static constexpr uint32_t VERSION  = 1;
+
+    struct Header
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t directory_count;
+        uint32_t entry_count;
+        uint32_t lookup_count;
+        uint32_t strings_size;
+        uint32_t padding;
+    };
+
+    struct DirectoryRecord
+    {
+        uint32_t path_offset;
+        uint32_t path_length;
+        uint32_t first_entry;
+        uint32_t entry_count;
+        int64_t  mtime_sec;
+        int64_t  mtime_nsec;
+        uint32_t exists;
+        uint32_t padding;
+    };
+
+    struct EntryRecord
+    {
+        uint32_t name_offset;
+        uint32_t name_length;
+        uint32_t directory;
+    };
+
+    const char *      data   = nullptr; /* The mapping or `buffer` */
+    size_t            size   = 0;
+    bool              mapped = false;
+    std::vector<char> buffer; /* Used when the index is not backed by a file */
+
+    const Header *          header      = nullptr;
+    const DirectoryRecord * directories = nullptr;
+    const EntryRecord *     entries     = nullptr;
+    const uint32_t *        lookup      = nullptr; /* Entries sorted by name */
+    const char *            strings     = nullptr;
+
+    /**
+     *@brief Check the layout and point the tables into `data`
+     *
+     * @return false if the data is not a valid index
+     */
+    bool Attach();
+
+    std::string_view String(uint32_t offset, uint32_t length) const
+    {
+        return std::string_view(strings + offset, length);
+    }
+
+public:
+    CommandIndex() {}
+    ~CommandIndex() { Close(); }
+
+    CommandIndex(const CommandIndex &)             = delete;
+    CommandIndex & operator=(const CommandIndex &) = delete;
+
+    /**
+     *@brief Map an index file
+     *
+     * @param file the path of the file
+     * @return false if it does not exist or is not a valid index
+     */
+    bool Open(const std::string & file);
+
+    /**
+     *@brief Use an index built in memory
+     *
+     * @param content the result of `Build()`
+     */
+    void Assign(std::vector<char> && content);
+
+    /**
+     *@brief Unmap the index
+     */
+    void Close();
+
+    bool IsOpen() const { return header != nullptr; }
+
+    size_t DirectoryCount() const
+    {
+        return IsOpen() ? header->directory_count : 0;
+    }
+
+    /**
+     *@brief Find a directory of the index by path
+     *
+     * @return std::optional<size_t> its index, if present
+     */
+    std::optional<size_t> FindDirectory(std::string_view path) const;
+
+    /**
+     *@brief Check whether the directory was indexed in the given state
+     */
+    bool IsFresh(size_t directory, const timespec & mtime, bool exists) const;
+
+    std::string_view DirectoryPath(size_t directory) const
+    {
+        return String(directories[directory].path_offset,
+                      directories[directory].path_length);
+    }
+
+    /**
+     *@brief Copy the names of the executables in a directory
+     */
+    std::vector<std::string> DirectoryNames(size_t directory) const;
+
+    /**
+     *@brief Get the number of distinct commands
+     */
+    size_t Size() const { return IsOpen() ? header->lookup_count : 0; }
+
+    /**
+     *@brief Get the name of the i-th command in lexicographic order
+     */
+    std::string_view Name(size_t i) const
+    {
+        const EntryRecord & entry = entries[lookup[i]];
+        return String(entry.name_offset, entry.name_length);
+    }
+
+    /**
+     *@brief Get the directory of the i-th command in lexicographic order
+     */
+    size_t Directory(size_t i) const { return entries[lookup[i]].directory; }
+
+    /**
+     *@brief Find a command by name with a binary search
+     *
+     * @return std::optional<size_t> its position in lexicographic order
+     */
+    std::optional<size_t> Find(std::string_view name) const;
+
+    /**
+     *@brief Find the first command not less than the prefix
+     *
+     * @return size_t its position, the commands with the prefix follow it
+     */
+    size_t LowerBound(std::string_view prefix) const;
+
+    /**
+     *@brief Serialize the listings into the index format
+     *
+     * @param listings the PATH directories in PATH order
+     * @return std::vector<char> the content of the index
+     */
+    static std::vector<char>
+    Build(const std::vector<DirectoryListing> & listings);
+
+    /**
+     *@brief Write an index atomically, creating its directory if needed
+     *
+     * @param file the path of the file
+     * @param content the result of `Build()`
+     * @return false if it could not be written
+     */
+    static bool Write(const std::string &       file,
+                      const std::vector<char> & content);
+};
+
+#endif // !_COMMAND_INDEX_H_
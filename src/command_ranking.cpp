@@ -0,0 +1,178 @@
+#include "command_ranking.h"
+#include "command_index.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+std::string CommandRanking::DefaultFile()
+{
+    if (const char * file = getenv("SHELL_COMMAND_RANKS"))
+        return file;
+
+    const char * cache_home = getenv("XDG_CACHE_HOME");
+    const char * home       = getenv("HOME");
+    if (cache_home && *cache_home)
+        return std::string(cache_home) + "/codecrafters-shell/ranks";
+    if (home && *home)
+        return std::string(home) + "/.cache/codecrafters-shell/ranks";
+
+    return ""; /* Nowhere to keep it */
+}
+
+double CommandRanking::Decay(const Rank & rank, int64_t now)
+{
+    if (now <= rank.time)
+        return rank.score;
+
+    return rank.score * std::exp2(-(now - rank.time) / HALF_LIFE);
+}
+
+void CommandRanking::Merge(std::string_view name, double score, int64_t time)
+{
+    auto iter = ranks.find(name);
+    if (iter == ranks.end())
+        iter = ranks.emplace(std::string(name), Rank()).first;
+
+    Rank & rank = iter->second;
+    if (time >= rank.time)
+    {
+        rank.score = Decay(rank, time) + score;
+        rank.time  = time;
+    }
+    else /* An older line, decay it to the time of the rank */
+        rank.score += Decay({score, time}, rank.time);
+
+    return;
+}
+
+void CommandRanking::Open(const std::string & file)
+{
+    Close();
+    open = true;
+    if (file.empty())
+        return;
+
+    std::string content;
+    int         fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat status;
+    if (fd != -1 && fstat(fd, &status) == 0)
+    {
+        content.resize(status.st_size);
+        ssize_t length = read(fd, content.data(), content.size());
+        content.resize(length > 0 ? length : 0);
+    }
+    if (fd != -1)
+        close(fd);
+
+    // Each line is `time score name`
+    size_t line_count = 0;
+    for (size_t begin = 0; begin < content.size();)
+    {
+        size_t end = std::min(content.find('\n', begin), content.size());
+        const char * first = content.data() + begin;
+        const char * last  = content.data() + end;
+        begin              = end + 1;
+
+        int64_t time  = 0;
+        double  score = 0;
+        auto    result = std::from_chars(first, last, time);
+        if (result.ec != std::errc() || result.ptr == last)
+            continue;
+        result = std::from_chars(result.ptr + 1, last, score);
+        if (result.ec != std::errc() || result.ptr == last)
+            continue;
+
+        Merge(std::string_view(result.ptr + 1, last), score, time);
+        line_count++;
+    }
+
+    if (line_count > 2 * ranks.size() + 64)
+        Compact(file);
+
+    std::error_code error;
+    fs::create_directories(fs::path(file).parent_path(), error);
+    append_fd = ::open(file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                       0600);
+
+    return;
+}
+
+void CommandRanking::Compact(const std::string & file) const
+{
+    int64_t           now = std::time(nullptr);
+    std::vector<char> content;
+    char              number[32];
+
+    for (const auto & [name, rank] : ranks)
+    {
+        double score = Decay(rank, now);
+        if (score < MIN_SCORE)
+            continue;
+
+        char * end = std::to_chars(number, number + sizeof(number), now).ptr;
+        *end++     = ' ';
+        end = std::to_chars(end, number + sizeof(number), score).ptr;
+        *end++ = ' ';
+        content.insert(content.end(), number, end);
+        content.insert(content.end(), name.begin(), name.end());
+        content.push_back('\n');
+    }
+
+    // Lines appended by another shell meanwhile are lost, they only rank
+    CommandIndex::Write(file, content);
+
+    return;
+}
+
+void CommandRanking::Close()
+{
+    ranks.clear();
+    open = false;
+
+    if (append_fd != -1)
+        close(append_fd);
+    append_fd = -1;
+
+    return;
+}
+
+void CommandRanking::Record(std::string_view name)
+{
+    int64_t now = std::time(nullptr);
+    Merge(name, 1, now);
+
+    if (append_fd != -1)
+    {
+        // A single write, so the line is never interleaved with another shell
+        std::string line = std::to_string(now) + " 1 ";
+        line.append(name).push_back('\n');
+        if (write(append_fd, line.data(), line.size()) == -1)
+        {
+            close(append_fd);
+            append_fd = -1;
+        }
+    }
+
+    return;
+}
+
+std::vector<std::pair<std::string_view, double>>
+CommandRanking::Scores(int64_t now) const
+{
+    std::vector<std::pair<std::string_view, double>> scores;
+    scores.reserve(ranks.size());
+    for (const auto & [name, rank] : ranks)
+        scores.emplace_back(name, Decay(rank, now));
+    std::sort(scores.begin(), scores.end());
+
+    return scores;
+}
@@ -0,0 +1,94 @@
+#ifndef _COMMAND_RANKING_H_
+#define _COMMAND_RANKING_H_
+
+#include "tools.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ *@brief How often and how recently each command was run, to rank completions
+ *
+ * The score of a command grows by one each time it runs and halves every
+ * week, so it reflects both the frequency and the recency of its use. Each
+ * run is appended to the file as one line with a single `write()`, like the
+ * history; the file is compacted when it is loaded with far more lines than
+ * commands.
+ */
+class CommandRanking
+{
+private:
+    struct Rank
+    {
+        double  score = 0;
+        int64_t time  = 0; /* When the score was computed, in seconds */
+    };
+
+    std::unordered_map<std::string, Rank, StringHash, std::equal_to<>> ranks;
+    int  append_fd = -1;
+    bool open      = false;
+
+    static constexpr double HALF_LIFE = 7 * 24 * 3600.0;
+    static constexpr double MIN_SCORE = 0.01; /* Forgotten when compacting */
+
+    /**
+     *@brief Get the score of a rank at a later time
+     */
+    static double Decay(const Rank & rank, int64_t now);
+
+    /**
+     *@brief Add a score earned at a time to a command
+     */
+    void Merge(std::string_view name, double score, int64_t time);
+
+    /**
+     *@brief Rewrite the file with one line per command
+     */
+    void Compact(const std::string & file) const;
+
+public:
+    CommandRanking() {}
+    ~CommandRanking() { Close(); }
+
+    CommandRanking(const CommandRanking &)             = delete;
+    CommandRanking & operator=(const CommandRanking &) = delete;
+
+    /**
+     *@brief Get the default ranking file
+     *
+     * It is `$SHELL_COMMAND_RANKS` if set, which may be empty to keep no
+     * file, or `codecrafters-shell/ranks` in the user cache directory.
+     */
+    static std::string DefaultFile();
+
+    /**
+     *@brief Load the file and start recording the commands run
+     *
+     * @param file the path of the file, empty to keep the scores in memory
+     */
+    void Open(const std::string & file);
+
+    void Close();
+
+    bool IsOpen() const { return open; }
+
+    /**
+     *@brief Count a run of a command
+     */
+    void Record(std::string_view name);
+
+    /**
+     *@brief Get the scores of the commands that ran, sorted by name
+     *
+     * A walk over the commands in order can find their scores by merging
+     * instead of one lookup each.
+     *
+     * @param now the current time, in seconds
+     */
+    std::vector<std::pair<std::string_view, double>> Scores(int64_t now) const;
+};
+
+#endif // !_COMMAND_RANKING_H_
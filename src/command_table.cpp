@@ -0,0 +1,389 @@
+#include "command_table.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+bool CommandTable::UpdateDirectory(Directory & directory)
+{
+    struct stat status;
+    bool        exists =
+        stat(directory.path.c_str(), &status) == 0 && S_ISDIR(status.st_mode);
+    timespec mtime = exists ? status.st_mtim : timespec{};
+
+    bool changed = exists != directory.exists ||
+                   mtime.tv_sec != directory.mtime.tv_sec ||
+                   mtime.tv_nsec != directory.mtime.tv_nsec;
+
+    directory.exists = exists;
+    directory.mtime  = mtime;
+
+    return changed;
+}
+
+std::string CommandTable::DefaultIndexFile()
+{
+    if (const char * file = getenv("SHELL_COMMAND_INDEX"))
+        return file;
+
+    std::string directory;
+    const char * cache_home = getenv("XDG_CACHE_HOME");
+    const char * home       = getenv("HOME");
+    if (cache_home && *cache_home)
+        directory = cache_home;
+    else if (home && *home)
+        directory = std::string(home) + "/.cache";
+    else /* Nowhere to keep it */
+        return "";
+
+    return directory + "/codecrafters-shell/commands.idx";
+}
+
+bool CommandTable::IndexMatchesDirectories() const
+{
+    if (!index.IsOpen() || index.DirectoryCount() != directories.size())
+        return false;
+
+    for (size_t i = 0; i < directories.size(); i++)
+        if (index.DirectoryPath(i) != directories[i].path ||
+            !index.IsFresh(i, directories[i].mtime, directories[i].exists))
+            return false;
+
+    return true;
+}
+
+CommandTable::CacheEntry CommandTable::Probe(std::string_view name) const
+{
+    CacheEntry  entry;
+    struct stat status;
+
+    // The first executable file in PATH order wins
+    for (size_t i = 0; i < directories.size(); i++)
+    {
+        if (!directories[i].exists)
+            continue;
+
+        std::string path = directories[i].path + '/';
+        path.append(name);
+
+        if (stat(path.c_str(), &status) == 0 && S_ISREG(status.st_mode) &&
+            access(path.c_str(), X_OK) == 0)
+        {
+            entry.path      = std::move(path);
+            entry.directory = i;
+            break;
+        }
+    }
+
+    return entry;
+}
+
+CommandTable::CacheEntry CommandTable::Search(std::string_view name)
+{
+    CacheEntry entry;
+
+    // Without a fresh index only this name is probed, the directories are
+    // scanned when the completion asks for the index
+    if (!index_fresh)
+        return Probe(name);
+
+    // A command changed during the session is not in the index yet
+    if (auto iter = overrides.find(name); iter != overrides.end())
+        return iter->second;
+
+    // The index already resolved the PATH precedence
+    if (std::optional<size_t> position = index.Find(name))
+    {
+        entry.directory = index.Directory(*position);
+        entry.path      = directories[entry.directory].path + '/';
+        entry.path.append(name);
+    }
+
+    return entry;
+}
+
+void CommandTable::WatchDirectory(Directory & directory)
+{
+    directory.watch = watcher.Watch(directory.path);
+
+    return;
+}
+
+void CommandTable::ApplyEvents()
+{
+    std::vector<std::string> names;
+    bool                     overflow = false;
+
+    watcher.ReadEvents([&](int watch, uint32_t mask, std::string_view name) {
+        // Events were dropped, nothing but a rebuild can tell what changed
+        if (mask & IN_Q_OVERFLOW)
+        {
+            overflow = true;
+            return;
+        }
+
+        // The same directory may appear several times in PATH
+        for (Directory & directory : directories)
+        {
+            if (directory.watch != watch)
+                continue;
+
+            // The directory itself is gone, fall back to `stat()`
+            if (mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+                directory.watch = -1;
+            else
+                directory.touched = true;
+        }
+
+        if (!name.empty() && !(mask & IN_ISDIR))
+            names.emplace_back(name);
+    });
+
+    if (overflow)
+    {
+        for (Directory & directory : directories) directory.touched = true;
+        cache.clear();
+        index_fresh = false;
+        return;
+    }
+
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    // Resolve each changed name again, without rescanning its directory
+    for (std::string & name : names)
+    {
+        CacheEntry entry = Probe(name);
+        cache.erase(name);
+        changes.insert_or_assign(name, entry);
+        overrides.insert_or_assign(std::move(name), std::move(entry));
+    }
+
+    return;
+}
+
+void CommandTable::Revalidate(std::string_view new_path_variable)
+{
+    // PATH itself changed, start over
+    if (new_path_variable != path_variable || directories.empty())
+    {
+        path_variable = new_path_variable;
+        directories.clear();
+        cache.clear();
+        overrides.clear();
+        changes.clear();
+        watcher.Close();
+
+        size_t begin = 0;
+        while (begin <= path_variable.size())
+        {
+            size_t end = path_variable.find(':', begin);
+            if (end == std::string::npos)
+                end = path_variable.size();
+
+            // An empty entry means the current directory
+            Directory directory;
+            directory.path = (end == begin)
+                                 ? "."
+                                 : path_variable.substr(begin, end - begin);
+
+            // Watch it first, so no change falls between the two
+            WatchDirectory(directory);
+            UpdateDirectory(directory);
+            directories.push_back(std::move(directory));
+
+            begin = end + 1;
+        }
+
+        // Map the index written by an earlier shell, once
+        if (!index_loaded && !index_file.empty())
+            index.Open(index_file);
+        index_loaded = true;
+        index_fresh  = IndexMatchesDirectories();
+        generation++;
+
+        return;
+    }
+
+    ApplyEvents();
+
+    // Find the first directory changed since the last check among the ones
+    // inotify does not report on
+    size_t first_changed = directories.size();
+    for (size_t i = 0; i < directories.size(); i++)
+    {
+        if (directories[i].watch != -1)
+            continue;
+
+        // A directory created since it was last checked can be watched now
+        WatchDirectory(directories[i]);
+        if (UpdateDirectory(directories[i]) &&
+            first_changed == directories.size())
+            first_changed = i;
+    }
+
+    if (first_changed == directories.size())
+        return;
+
+    /**
+     * A change may add a command shadowing the ones found in later
+     * directories, or make any missing command appear
+     */
+    std::erase_if(cache, [&](const auto & item) {
+        return item.second.path.empty() ||
+               item.second.directory >= first_changed;
+    });
+    index_fresh = false;
+
+    return;
+}
+
+const std::string * CommandTable::Find(std::string_view name, bool count_hit)
+{
+    // Paths are not looked up in PATH
+    if (name.empty() || name.find('/') != std::string_view::npos)
+        return nullptr;
+
+    auto iter = cache.find(name);
+    if (iter == cache.end()) /* Resolve it on first use */
+        iter = cache.emplace(std::string(name), Search(name)).first;
+
+    if (iter->second.path.empty()) /* The cached negative lookup */
+        return nullptr;
+
+    if (count_hit)
+        iter->second.hits++;
+
+    return &iter->second.path;
+}
+
+std::vector<std::string> CommandTable::ScanDirectory(const std::string & path)
+{
+    std::vector<std::string> names;
+
+    int directory_fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory_fd == -1)
+        return names;
+
+    // Read the entries in bulk instead of one readdir() call each
+    std::vector<char> buffer(1 << 16);
+    long              length = 0;
+    struct stat       status;
+
+    while ((length = syscall(SYS_getdents64, directory_fd, buffer.data(),
+                             buffer.size())) > 0)
+        for (long offset = 0; offset < length;)
+        {
+            auto * entry =
+                reinterpret_cast<dirent64 *>(buffer.data() + offset);
+            offset += entry->d_reclen;
+
+            std::string_view name = entry->d_name;
+            if (name == "." || name == ".." || entry->d_type == DT_DIR)
+                continue;
+
+            // Only links and unknown types need a stat to find the file type
+            if (entry->d_type != DT_REG &&
+                (fstatat(directory_fd, entry->d_name, &status, 0) != 0 ||
+                 !S_ISREG(status.st_mode)))
+                continue;
+
+            if (faccessat(directory_fd, entry->d_name, X_OK, 0) == 0)
+                names.emplace_back(name);
+        }
+
+    close(directory_fd);
+
+    return names;
+}
+
+void CommandTable::Rebuild()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // Keep the listings of the directories that did not change
+    std::vector<DirectoryListing> listings(directories.size());
+    std::vector<size_t>           targets; /* The directories to scan */
+    size_t                        reused = 0;
+
+    for (size_t i = 0; i < directories.size(); i++)
+    {
+        // Its inotify events only recorded single commands, rescan it
+        bool touched           = directories[i].touched;
+        directories[i].touched = false;
+        if (touched)
+            UpdateDirectory(directories[i]);
+
+        listings[i].path   = directories[i].path;
+        listings[i].mtime  = directories[i].mtime;
+        listings[i].exists = directories[i].exists;
+
+        if (!directories[i].exists)
+            continue;
+
+        std::optional<size_t> indexed =
+            index.FindDirectory(directories[i].path);
+        if (!touched && indexed &&
+            index.IsFresh(*indexed, directories[i].mtime, true))
+        {
+            listings[i].names = index.DirectoryNames(*indexed);
+            reused++;
+        }
+        else
+            targets.push_back(i);
+    }
+
+    // Each worker takes the next directory until none is left
+    std::atomic<size_t> next = 0;
+    auto                work = [&]() {
+        for (size_t i; (i = next++) < targets.size();)
+            listings[targets[i]].names =
+                ScanDirectory(directories[targets[i]].path);
+    };
+
+    // Reading directories mostly waits on the file system, not on the CPU
+    size_t thread_count = std::min(targets.size(), MAX_SCAN_THREADS);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < thread_count; i++) threads.emplace_back(work);
+    work(); /* This thread is a worker as well */
+    for (std::thread & thread : threads) thread.join();
+
+    // Share it with the other shells, or keep it in memory if it cannot be
+    std::vector<char> content = CommandIndex::Build(listings);
+    statistics.persisted      = !index_file.empty() &&
+                           CommandIndex::Write(index_file, content) &&
+                           index.Open(index_file) && IndexMatchesDirectories();
+    if (!statistics.persisted)
+        index.Assign(std::move(content));
+
+    // The scan saw the changes recorded on top of the old index
+    overrides.clear();
+    changes.clear();
+    index_fresh = true;
+    generation++;
+
+    statistics.duration =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+    statistics.directories = targets.size();
+    statistics.reused      = reused;
+    statistics.entries     = index.Size();
+    statistics.threads     = std::max<size_t>(thread_count, 1);
+    statistics.scans++;
+
+    return;
+}
+
+const CommandIndex & CommandTable::GetIndex()
+{
+    if (!index_fresh)
+        Rebuild();
+
+    return index;
+}
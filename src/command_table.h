@@ -0,0 +1,222 @@
+#ifndef _COMMAND_TABLE_H_
+#define _COMMAND_TABLE_H_
+
+#include "command_index.h"
+#include "directory_watcher.h"
+#include "tools.h"
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ *@brief The external commands found in PATH
+ *
+ * Commands are resolved lazily like the hash table of bash: a name is only
+ * looked up the first time it is used, and the result, found or not, is
+ * cached. The lookups are served by a `CommandIndex` mapped from a file
+ * shared by all shells, which is keyed by the modification time of the PATH
+ * directories: only the directories that changed since it was written are
+ * scanned again, and only the cache entries they may affect are dropped.
+ *
+ * The directories are watched with inotify during the session: a command
+ * added or removed is resolved again on its own and recorded on top of the
+ * index, so a change does not cost a rescan of its directory.
+ */
+class CommandTable
+{
+public:
+    struct CacheEntry
+    {
+        std::string path;          /* Empty if the command was not found */
+        size_t      directory = 0; /* The index of the directory in PATH */
+        unsigned    hits      = 0; /* How many times it has been executed */
+    };
+
+    using Cache = std::unordered_map<std::string, CacheEntry, StringHash,
+                                     std::equal_to<>>;
+
+    struct ScanStatistics
+    {
+        std::chrono::microseconds duration{0}; /* Wall time of the last scan */
+        size_t                    directories = 0; /* Directories scanned */
+        size_t                    reused  = 0; /* Directories from the index */
+        size_t                    entries = 0; /* Commands in the index */
+        size_t                    threads = 0;
+        unsigned                  scans   = 0;
+        bool                      persisted = false; /* The index was saved */
+    };
+
+private:
+    struct Directory
+    {
+        std::string path;
+        timespec    mtime   = {};
+        bool        exists  = false;
+        int         watch   = -1;    /* The inotify watch, -1 if not watched */
+        bool        touched = false; /* Changed since the index was built */
+    };
+
+    std::string            path_variable; /* The PATH the table is built of */
+    std::vector<Directory> directories;
+    Cache                  cache;
+    DirectoryWatcher       watcher;
+    Cache overrides; /* The commands changed since the index was built */
+    Cache changes;   /* The overrides not taken by `TakeChanges()` yet */
+
+    CommandIndex   index;
+    std::string    index_file;          /* Empty if it is not persisted */
+    bool           index_loaded = false; /* The file has been mapped once */
+    bool           index_fresh  = false; /* The index matches `directories` */
+    unsigned       generation   = 0;     /* Bumped whenever `index` changes */
+    ScanStatistics statistics;
+
+    // The number of threads scanning the PATH directories at most
+    static constexpr size_t MAX_SCAN_THREADS = 8;
+
+    /**
+     *@brief List the executables of a directory with `getdents64()`
+     *
+     * @param path the path of the directory
+     * @return std::vector<std::string> the names of the executables
+     */
+    static std::vector<std::string> ScanDirectory(const std::string & path);
+
+    /**
+     *@brief Rebuild the index, scanning the stale directories concurrently
+     */
+    void Rebuild();
+
+    /**
+     *@brief Check whether the index describes exactly the PATH directories
+     */
+    bool IndexMatchesDirectories() const;
+
+    /**
+     *@brief Read the modification time of a directory
+     *
+     * @param directory the directory to update
+     * @return true if it changed since the last call
+     */
+    static bool UpdateDirectory(Directory & directory);
+
+    /**
+     *@brief Search a name in PATH with `stat()`, ignoring the index
+     *
+     * @param name the name of the command
+     * @return CacheEntry the entry to cache
+     */
+    CacheEntry Probe(std::string_view name) const;
+
+    /**
+     *@brief Watch the directory and clear its watch if it cannot be watched
+     */
+    void WatchDirectory(Directory & directory);
+
+    /**
+     *@brief Apply the pending inotify events
+     *
+     * Each changed name is probed again and overrides the index.
+     */
+    void ApplyEvents();
+
+    /**
+     *@brief Search a name in the overrides, then in the index, or with
+     * `Probe()` if the index is not fresh
+     *
+     * @param name the name of the command
+     * @return CacheEntry the entry to cache
+     */
+    CacheEntry Search(std::string_view name);
+
+public:
+    /**
+     *@brief Construct a new Command Table
+     *
+     * @param index_file where the index is shared between shells, empty to
+     * keep it in memory
+     */
+    explicit CommandTable(std::string index_file)
+        : index_file(std::move(index_file))
+    {
+    }
+    ~CommandTable() {}
+
+    /**
+     *@brief Get the default location of the index file
+     *
+     * It is `$SHELL_COMMAND_INDEX` if set, which may be empty to disable the
+     * file, or `commands.idx` in the cache directory of the user.
+     */
+    static std::string DefaultIndexFile();
+
+    /**
+     *@brief Check the PATH directories and drop the stale cache entries
+     *
+     * It applies the inotify events and only calls `stat()` on the
+     * directories that are not watched, so it is run before each command
+     * line rather than on each lookup.
+     *
+     * @param new_path_variable the current value of PATH
+     */
+    void Revalidate(std::string_view new_path_variable);
+
+    /**
+     *@brief Get the PATH the table is built of
+     */
+    const std::string & PathVariable() const { return path_variable; }
+
+    /**
+     *@brief Resolve the command
+     *
+     * @param name the name of the command
+     * @param count_hit whether it is looked up to be executed
+     * @return const std::string * the absolute path, or nullptr if not found
+     */
+    const std::string * Find(std::string_view name, bool count_hit = false);
+
+    /**
+     *@brief Get every command in PATH, rebuilding the index if it is stale
+     */
+    const CommandIndex & GetIndex();
+
+    /**
+     *@brief Get the commands changed since the index was built
+     *
+     * An entry with an empty path is a command that was removed.
+     */
+    const Cache & GetOverrides() const { return overrides; }
+
+    /**
+     *@brief Take the commands changed since the last call
+     *
+     * @return Cache the changes, in the same form as `GetOverrides()`
+     */
+    Cache TakeChanges() { return std::exchange(changes, Cache()); }
+
+    /**
+     *@brief Get the number of times the index has changed
+     */
+    unsigned GetGeneration() const { return generation; }
+
+    /**
+     *@brief Get the statistics of the last rebuild of the index
+     */
+    const ScanStatistics & GetScanStatistics() const { return statistics; }
+
+    /**
+     *@brief Get the cached lookups
+     */
+    const Cache & GetCache() const { return cache; }
+
+    /**
+     *@brief Forget all the cached lookups
+     */
+    void Reset() { cache.clear(); }
+};
+
+#endif // !_COMMAND_TABLE_H_
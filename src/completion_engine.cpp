@@ -0,0 +1,120 @@
+#include "completion_engine.h"
+
+void CompletionEngine::Start(Compute new_compute)
+{
+    Stop();
+
+    compute  = std::move(new_compute);
+    stopping = false;
+    worker   = std::thread([this]() { Run(); });
+
+    return;
+}
+
+void CompletionEngine::Stop()
+{
+    if (!worker.joinable())
+        return;
+
+    {
+        std::lock_guard lock(request_mutex);
+        stopping = true;
+        pending  = false;
+        working  = false;
+        latest++;
+        result.reset();
+    }
+    requested.notify_one();
+    finished.notify_all();
+    worker.join();
+
+    return;
+}
+
+void CompletionEngine::Request(std::string_view line, size_t cursor)
+{
+    if (!worker.joinable())
+        return;
+
+    {
+        std::lock_guard lock(request_mutex);
+        request_line.assign(line);
+        request_cursor = cursor;
+        pending        = true;
+        working        = true;
+        latest++;
+        result.reset();
+    }
+    requested.notify_one();
+
+    return;
+}
+
+void CompletionEngine::Cancel()
+{
+    std::lock_guard lock(request_mutex);
+    pending = false;
+    working = false;
+    latest++;
+    result.reset();
+    finished.notify_all();
+
+    return;
+}
+
+std::shared_ptr<const Completion>
+CompletionEngine::Find(std::string_view line, size_t cursor)
+{
+    std::unique_lock lock(request_mutex);
+
+    // The worker is on this line, the answer is close
+    uint64_t request = latest;
+    finished.wait(lock, [&]() {
+        return !working || latest != request || request_line != line ||
+               request_cursor != cursor;
+    });
+
+    if (!result || result->line != line || result->cursor != cursor)
+        return nullptr;
+
+    return result;
+}
+
+void CompletionEngine::Run()
+{
+    std::unique_lock lock(request_mutex);
+
+    while (true)
+    {
+        requested.wait(lock, [&]() { return stopping || pending; });
+        if (stopping)
+            break;
+
+        uint64_t   request = latest;
+        Completion completion;
+        completion.line   = request_line;
+        completion.cursor = request_cursor;
+        pending           = false;
+        lock.unlock();
+
+        auto cancelled = [&]() {
+            return latest.load(std::memory_order_relaxed) != request;
+        };
+
+        {
+            std::lock_guard state(state_mutex);
+            if (!cancelled())
+                compute(completion, cancelled);
+        }
+
+        lock.lock();
+        if (latest == request)
+        {
+            result  = std::make_shared<const Completion>(std::move(completion));
+            working = false;
+            finished.notify_all();
+        }
+    }
+
+    return;
+}
@@ -0,0 +1,118 @@
+#ifndef _COMPLETION_ENGINE_H_
+#define _COMPLETION_ENGINE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ *@brief What pressing Tab does to a line
+ */
+struct Completion
+{
+    std::string line; /* The line and the cursor it was computed for */
+    size_t      cursor = 0;
+
+    bool        found = false; /* Whether anything matches */
+    bool        unique = false; /* Otherwise the bell rings */
+    size_t      begin  = 0;     /* The text replaces the line from here */
+    std::string text;           /* up to the cursor */
+
+    bool                     listed = false; /* `candidates` is filled */
+    std::vector<std::string> candidates;     /* Listed on a double Tab */
+};
+
+/**
+ *@brief Compute the completion of the line being typed on a worker thread
+ *
+ * Each edit of the line requests the completion of the new line, which
+ * cancels the one in progress, so by the time Tab is pressed the answer is
+ * usually ready. The state the completion reads, the command table, the
+ * completion tree and the directory listings, is only used under
+ * `StateMutex()`: the worker holds it while computing, and the shell while
+ * it completes or runs a command.
+ */
+class CompletionEngine
+{
+public:
+    /**
+     *@brief Whether the work in progress is stale
+     */
+    using Cancelled = std::function<bool()>;
+
+    /**
+     *@brief Compute the completion of `completion.line`, with its
+     * candidates, giving up early once cancelled
+     */
+    using Compute =
+        std::function<void(Completion & completion, const Cancelled & cancelled)>;
+
+private:
+    Compute     compute;
+    std::thread worker;
+    std::mutex  state_mutex;
+
+    // The requests and the result, under `request_mutex`
+    std::mutex                request_mutex;
+    std::condition_variable   requested; /* A request or a stop */
+    std::condition_variable   finished;  /* The request was answered */
+    std::atomic<uint64_t>     latest = 0; /* The current request */
+    std::string               request_line;
+    size_t                    request_cursor = 0;
+    bool                      pending  = false; /* Not started yet */
+    bool                      working  = false; /* Pending or in progress */
+    bool                      stopping = false;
+    std::shared_ptr<const Completion> result;
+
+    void Run();
+
+public:
+    CompletionEngine() {}
+    ~CompletionEngine() { Stop(); }
+
+    CompletionEngine(const CompletionEngine &)             = delete;
+    CompletionEngine & operator=(const CompletionEngine &) = delete;
+
+    /**
+     *@brief Start the worker thread
+     */
+    void Start(Compute new_compute);
+
+    /**
+     *@brief Drop the request and wait until the worker thread is gone
+     */
+    void Stop();
+
+    /**
+     *@brief Compute the completion of a line in the background
+     */
+    void Request(std::string_view line, size_t cursor);
+
+    /**
+     *@brief Drop the request and make the work in progress stop early
+     */
+    void Cancel();
+
+    /**
+     *@brief Get the completion of a line if it was requested
+     *
+     * Waits for it if the worker is still on it. The result is kept for the
+     * next Tab on the same line.
+     *
+     * @return std::shared_ptr<const Completion> the completion, nullptr if
+     * it is not known
+     */
+    std::shared_ptr<const Completion> Find(std::string_view line,
+                                           size_t           cursor);
+
+    std::mutex & StateMutex() { return state_mutex; }
+};
+
+#endif // !_COMPLETION_ENGINE_H_
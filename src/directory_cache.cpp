@@ -0,0 +1,123 @@
+#include "directory_cache.h"
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+bool DirectoryCache::Read(const std::string &           path,
+                          std::vector<DirectoryEntry> & entries,
+                          const Cancelled &             cancelled)
+{
+    int directory_fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory_fd == -1)
+        return false;
+
+    // Read the entries in bulk instead of one readdir() call each
+    std::vector<char> buffer(1 << 16);
+    long              length = 0;
+    struct stat       status;
+
+    entries.clear();
+    while ((length = syscall(SYS_getdents64, directory_fd, buffer.data(),
+                             buffer.size())) > 0)
+    {
+        // A slow directory is given up as soon as nobody waits for it
+        if (cancelled && cancelled())
+        {
+            close(directory_fd);
+            return false;
+        }
+
+        for (long offset = 0; offset < length;)
+        {
+            auto * entry =
+                reinterpret_cast<dirent64 *>(buffer.data() + offset);
+            offset += entry->d_reclen;
+
+            std::string_view name = entry->d_name;
+            if (name == "." || name == "..")
+                continue;
+
+            // Only links and unknown types need a stat to find the file type
+            bool is_directory = entry->d_type == DT_DIR;
+            bool is_link      = entry->d_type == DT_LNK;
+            if (entry->d_type == DT_UNKNOWN)
+                is_link = fstatat(directory_fd, entry->d_name, &status,
+                                  AT_SYMLINK_NOFOLLOW) == 0 &&
+                          S_ISLNK(status.st_mode);
+            if (is_link || entry->d_type == DT_UNKNOWN)
+                is_directory =
+                    fstatat(directory_fd, entry->d_name, &status, 0) == 0 &&
+                    S_ISDIR(status.st_mode);
+
+            entries.push_back({std::string(name), is_directory, is_link});
+        }
+    }
+
+    close(directory_fd);
+
+    std::sort(entries.begin(), entries.end(),
+              [](const DirectoryEntry & a, const DirectoryEntry & b) {
+                  return a.name < b.name;
+              });
+
+    return true;
+}
+
+const std::vector<DirectoryEntry> *
+DirectoryCache::List(const std::string & path, const Cancelled & cancelled)
+{
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0 || !S_ISDIR(status.st_mode))
+        return nullptr;
+
+    auto iter = listings.find(path);
+
+    // An entry added or removed changes the mtime of the directory
+    if (iter == listings.end() || iter->second.device != status.st_dev ||
+        iter->second.inode != status.st_ino ||
+        iter->second.mtime.tv_sec != status.st_mtim.tv_sec ||
+        iter->second.mtime.tv_nsec != status.st_mtim.tv_nsec)
+    {
+        Listing listing;
+        listing.device = status.st_dev;
+        listing.inode  = status.st_ino;
+        listing.mtime  = status.st_mtim;
+        if (!Read(path, listing.entries, cancelled))
+            return nullptr;
+
+        // Make room by dropping the listing used the longest time ago
+        if (iter == listings.end() && listings.size() >= MAX_LISTINGS)
+            listings.erase(std::min_element(
+                listings.begin(), listings.end(),
+                [](const auto & a, const auto & b) {
+                    return a.second.last_use < b.second.last_use;
+                }));
+
+        iter = listings.insert_or_assign(path, std::move(listing)).first;
+    }
+
+    iter->second.last_use = ++clock;
+
+    return &iter->second.entries;
+}
+
+std::span<const DirectoryEntry>
+DirectoryCache::WithPrefix(const std::vector<DirectoryEntry> & entries,
+                           std::string_view                    prefix)
+{
+    // The names with the prefix follow each other in sorted order
+    auto first = std::lower_bound(
+        entries.begin(), entries.end(), prefix,
+        [](const DirectoryEntry & entry, std::string_view value) {
+            return std::string_view(entry.name) < value;
+        });
+    auto last = std::partition_point(first, entries.end(),
+                                     [&](const DirectoryEntry & entry) {
+                                         return entry.name.starts_with(prefix);
+                                     });
+
+    return std::span<const DirectoryEntry>(first, last);
+}
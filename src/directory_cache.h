@@ -0,0 +1,97 @@
+#ifndef _DIRECTORY_CACHE_H_
+#define _DIRECTORY_CACHE_H_
+
+#include "tools.h"
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+struct DirectoryEntry
+{
+    std::string name;
+    bool        is_directory = false; /* Following symbolic links */
+    bool        is_link      = false;
+};
+
+/**
+ *@brief Sorted listings of directories, kept while they do not change
+ *
+ * A listing is reused as long as the directory has the same inode and
+ * modification time, so listing a large directory again only costs a
+ * `stat()`. The least recently used listings are dropped past a limit.
+ */
+class DirectoryCache
+{
+public:
+    /**
+     *@brief Whether to give up reading a directory
+     */
+    using Cancelled = std::function<bool()>;
+
+private:
+    struct Listing
+    {
+        dev_t                       device = 0;
+        ino_t                       inode  = 0;
+        timespec                    mtime  = {};
+        std::vector<DirectoryEntry> entries; /* Sorted by name */
+        uint64_t                    last_use = 0;
+    };
+
+    std::unordered_map<std::string, Listing, StringHash, std::equal_to<>>
+             listings;
+    uint64_t clock = 0; /* Counts the uses, to find the oldest listing */
+
+    static constexpr size_t MAX_LISTINGS = 32;
+
+public:
+    DirectoryCache() {}
+    ~DirectoryCache() {}
+
+    /**
+     *@brief Read a directory with `getdents64()`, without caching it
+     *
+     * @param path the path of the directory
+     * @param entries the entries sorted by name
+     * @param cancelled checked between the blocks of entries read, if set
+     * @return false if it cannot be opened, or if cancelled
+     */
+    static bool Read(const std::string &           path,
+                     std::vector<DirectoryEntry> & entries,
+                     const Cancelled &             cancelled = nullptr);
+
+    /**
+     *@brief Get the listing of a directory
+     *
+     * @param path the absolute path of the directory
+     * @param cancelled checked between the blocks of entries read, if set
+     * @return const std::vector<DirectoryEntry> * the entries sorted by name,
+     * nullptr if it cannot be read
+     */
+    const std::vector<DirectoryEntry> *
+    List(const std::string & path, const Cancelled & cancelled = nullptr);
+
+    /**
+     *@brief Get the entries starting with a prefix
+     *
+     * @param entries a listing returned by `List()`
+     * @param prefix the prefix of the names
+     * @return std::span<const DirectoryEntry> the matching entries, in order
+     */
+    static std::span<const DirectoryEntry>
+    WithPrefix(const std::vector<DirectoryEntry> & entries,
+               std::string_view                    prefix);
+
+    /**
+     *@brief Forget every listing
+     */
+    void Clear() { listings.clear(); }
+};
+
+#endif // !_DIRECTORY_CACHE_H_
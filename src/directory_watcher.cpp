@@ -0,0 +1,50 @@
+#include "directory_watcher.h"
+#include <sys/inotify.h>
+#include <unistd.h>
+
+int DirectoryWatcher::Watch(const std::string & path)
+{
+    if (inotify_fd == -1)
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1)
+        return -1;
+
+    // Entries appearing, disappearing or becoming executable
+    return inotify_add_watch(inotify_fd, path.c_str(),
+                             IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                 IN_MOVED_TO | IN_ATTRIB | IN_CLOSE_WRITE |
+                                 IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+}
+
+void DirectoryWatcher::Close()
+{
+    // Closing the instance drops all of its watches
+    if (inotify_fd != -1)
+        close(inotify_fd);
+    inotify_fd = -1;
+
+    return;
+}
+
+void DirectoryWatcher::ReadEvents(const Handler & handler)
+{
+    if (inotify_fd == -1)
+        return;
+
+    alignas(inotify_event) char buffer[1 << 14];
+    ssize_t                     length;
+
+    while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+        for (ssize_t offset = 0; offset < length;)
+        {
+            auto * event = reinterpret_cast<inotify_event *>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+
+            // The name is padded with '\0' up to `len`
+            handler(event->wd, event->mask,
+                    event->len ? std::string_view(event->name)
+                               : std::string_view());
+        }
+
+    return;
+}
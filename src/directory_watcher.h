@@ -0,0 +1,58 @@
+#ifndef _DIRECTORY_WATCHER_H_
+#define _DIRECTORY_WATCHER_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+/**
+ *@brief Watch directories for added and removed entries with inotify
+ *
+ * The kernel queues the events while the shell is busy, so they are read
+ * without blocking whenever the shell needs an up-to-date view.
+ */
+class DirectoryWatcher
+{
+private:
+    int inotify_fd = -1;
+
+public:
+    /**
+     *@brief A directory entry changed
+     *
+     * @param watch the watch descriptor of the directory
+     * @param mask the inotify event mask
+     * @param name the name of the entry, empty for the directory itself
+     */
+    using Handler =
+        std::function<void(int watch, uint32_t mask, std::string_view name)>;
+
+    DirectoryWatcher() {}
+    ~DirectoryWatcher() { Close(); }
+
+    DirectoryWatcher(const DirectoryWatcher &)             = delete;
+    DirectoryWatcher & operator=(const DirectoryWatcher &) = delete;
+
+    /**
+     *@brief Start watching a directory
+     *
+     * @param path the path of the directory
+     * @return int the watch descriptor, -1 if it cannot be watched
+     */
+    int Watch(const std::string & path);
+
+    /**
+     *@brief Stop watching every directory
+     */
+    void Close();
+
+    /**
+     *@brief Handle the pending events without waiting for new ones
+     *
+     * @param handler called for each event in order
+     */
+    void ReadEvents(const Handler & handler);
+};
+
+#endif // !_DIRECTORY_WATCHER_H_
@@ -0,0 +1,312 @@
+#include "glob_expander.h"
+#include <algorithm>
+#include <cctype>
+#include <sys/stat.h>
+
+namespace
+{
+struct NamedClass
+{
+    std::string_view name;
+    int (*test)(int);
+};
+
+// The classes of `[[:name:]]`, in the C locale
+const NamedClass NAMED_CLASSES[] = {
+    {"alnum", [](int ch) { return std::isalnum(ch); }},
+    {"alpha", [](int ch) { return std::isalpha(ch); }},
+    {"blank", [](int ch) { return std::isblank(ch); }},
+    {"digit", [](int ch) { return std::isdigit(ch); }},
+    {"lower", [](int ch) { return std::islower(ch); }},
+    {"punct", [](int ch) { return std::ispunct(ch); }},
+    {"space", [](int ch) { return std::isspace(ch); }},
+    {"upper", [](int ch) { return std::isupper(ch); }},
+    {"xdigit", [](int ch) { return std::isxdigit(ch); }},
+};
+} // namespace
+
+GlobPattern::GlobPattern(std::string_view pattern)
+{
+    for (size_t position = 0; position < pattern.size();)
+    {
+        char ch = pattern[position++];
+
+        if (ch == '*')
+        {
+            // Several stars match what one does
+            if (steps.empty() || steps.back().type != STEP_STAR)
+                steps.push_back({STEP_STAR});
+            wildcards = true;
+        }
+        else if (ch == '?')
+        {
+            steps.push_back({STEP_ANY});
+            wildcards = true;
+        }
+        else if (ch == '[' && CompileClass(pattern, position))
+            wildcards = true;
+        else
+        {
+            if (ch == '\\' && position < pattern.size())
+                ch = pattern[position++];
+            if (!wildcards)
+                prefix.push_back(ch);
+            steps.push_back({STEP_CHARACTER, ch});
+        }
+    }
+
+    return;
+}
+
+bool GlobPattern::CompileClass(std::string_view pattern, size_t & position)
+{
+    size_t           i       = position;
+    bool             negated = i < pattern.size() &&
+                   (pattern[i] == '!' || pattern[i] == '^');
+    std::bitset<256> set;
+
+    if (negated)
+        i++;
+
+    // A `]` right after the `[` is a member, not the end
+    for (bool first = true;
+         i < pattern.size() && (pattern[i] != ']' || first); first = false)
+    {
+        if (pattern.substr(i).starts_with("[:"))
+        {
+            size_t close = pattern.find(":]", i + 2);
+            auto   named = std::find_if(
+                std::begin(NAMED_CLASSES), std::end(NAMED_CLASSES),
+                [&](const NamedClass & named) {
+                    return close != std::string_view::npos &&
+                           named.name == pattern.substr(i + 2, close - i - 2);
+                });
+            if (named != std::end(NAMED_CLASSES))
+            {
+                for (int ch = 0; ch < 256; ch++)
+                    if (named->test(ch))
+                        set.set(ch);
+                i = close + 2;
+                continue;
+            }
+        }
+
+        auto next = [&]() -> unsigned char {
+            if (pattern[i] == '\\' && i + 1 < pattern.size())
+                i++;
+            return pattern[i++];
+        };
+
+        unsigned char low  = next();
+        unsigned char high = low;
+        if (i + 1 < pattern.size() && pattern[i] == '-' && pattern[i + 1] != ']')
+        {
+            i++;
+            high = next();
+        }
+        for (unsigned ch = low; ch <= high; ch++)
+            set.set(ch);
+    }
+
+    if (i >= pattern.size())
+        return false;
+
+    if (negated)
+        set.flip();
+    classes.push_back(set);
+    steps.push_back({STEP_CLASS, 0, classes.size() - 1});
+    position = i + 1;
+
+    return true;
+}
+
+bool GlobPattern::Match(std::string_view name) const
+{
+    size_t step = 0, at = 0;
+
+    // Where to go on when the steps after the last star do not match
+    size_t star_step = std::string_view::npos, star_at = 0;
+
+    while (at < name.size())
+    {
+        if (step < steps.size())
+        {
+            const Step & current = steps[step];
+            if (current.type == STEP_STAR)
+            {
+                star_step = step++;
+                star_at   = at;
+                continue;
+            }
+
+            unsigned char ch = name[at];
+            if ((current.type == STEP_CHARACTER && current.ch == name[at]) ||
+                current.type == STEP_ANY ||
+                (current.type == STEP_CLASS && classes[current.klass][ch]))
+            {
+                step++;
+                at++;
+                continue;
+            }
+        }
+
+        // Let the last star take one more character
+        if (star_step == std::string_view::npos)
+            return false;
+        step = star_step + 1;
+        at   = ++star_at;
+    }
+
+    while (step < steps.size() && steps[step].type == STEP_STAR)
+        step++;
+
+    return step == steps.size();
+}
+
+const std::vector<DirectoryEntry> &
+GlobExpander::List(const std::string & path)
+{
+    auto iter = listings.find(path);
+    if (iter == listings.end())
+    {
+        std::vector<DirectoryEntry> entries;
+        if (!DirectoryCache::Read(path.empty() ? "." : path, entries))
+            entries.clear();
+        iter = listings.emplace(path, std::move(entries)).first;
+    }
+
+    return iter->second;
+}
+
+void GlobExpander::Walk(const std::vector<std::string_view> & components,
+                        size_t component, std::string & path,
+                        bool directories_only, std::string & buffer,
+                        std::vector<size_t> & found)
+{
+    size_t           length = path.size(); /* Put back before returning */
+    bool             last   = component + 1 == components.size();
+    std::string_view text   = components[component];
+
+    auto record = [&]() {
+        found.push_back(buffer.size());
+        buffer.append(path).push_back('\0');
+    };
+
+    // `**` matches this directory and every one under it
+    if (text == "**")
+    {
+        if (!last)
+            Walk(components, component + 1, path, directories_only, buffer,
+                 found);
+
+        for (const DirectoryEntry & entry : List(path))
+        {
+            if (entry.name.starts_with('.'))
+                continue;
+
+            path.append(entry.name);
+            if (last && (!directories_only || entry.is_directory))
+            {
+                if (directories_only)
+                    path.push_back('/');
+                record();
+                path.resize(length + entry.name.size());
+            }
+            if (entry.is_directory && !entry.is_link)
+            {
+                path.push_back('/');
+                Walk(components, component, path, directories_only, buffer,
+                     found);
+            }
+            path.resize(length);
+        }
+        return;
+    }
+
+    GlobPattern matcher(text);
+
+    // A component without wildcards is not listed, only checked at the end
+    if (!matcher.HasWildcards())
+    {
+        struct stat status;
+        path.append(matcher.Prefix());
+        if (!last)
+        {
+            path.push_back('/');
+            Walk(components, component + 1, path, directories_only, buffer,
+                 found);
+        }
+        else if (lstat(path.c_str(), &status) == 0 &&
+                 (!directories_only || (stat(path.c_str(), &status) == 0 &&
+                                        S_ISDIR(status.st_mode))))
+        {
+            if (directories_only)
+                path.push_back('/');
+            record();
+        }
+        path.resize(length);
+        return;
+    }
+
+    bool with_hidden = matcher.Prefix().starts_with('.');
+    for (const DirectoryEntry & entry :
+         DirectoryCache::WithPrefix(List(path), matcher.Prefix()))
+    {
+        if ((entry.name.starts_with('.') && !with_hidden) ||
+            ((!last || directories_only) && !entry.is_directory) ||
+            !matcher.Match(entry.name))
+            continue;
+
+        path.append(entry.name);
+        if (!last)
+        {
+            path.push_back('/');
+            Walk(components, component + 1, path, directories_only, buffer,
+                 found);
+        }
+        else
+        {
+            if (directories_only)
+                path.push_back('/');
+            record();
+        }
+        path.resize(length);
+    }
+
+    return;
+}
+
+size_t GlobExpander::Expand(std::string_view pattern, std::string & buffer,
+                            std::vector<std::string_view> & matches)
+{
+    std::vector<std::string_view> components;
+    for (size_t begin = 0; begin < pattern.size();)
+    {
+        size_t end = std::min(pattern.find('/', begin), pattern.size());
+        if (end > begin)
+            components.push_back(pattern.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    if (components.empty())
+        return 0;
+
+    std::string         path = pattern.starts_with('/') ? "/" : "";
+    std::vector<size_t> found;
+    Walk(components, 0, path, pattern.size() > 1 && pattern.ends_with('/'),
+         buffer, found);
+
+    // The buffer is complete, the views into it stay valid
+    size_t first = matches.size();
+    for (size_t i = 0; i < found.size(); i++)
+    {
+        size_t end = i + 1 < found.size() ? found[i + 1] : buffer.size();
+        matches.emplace_back(buffer.data() + found[i], end - found[i] - 1);
+    }
+
+    // A single component comes out of a sorted listing already
+    auto begin = matches.begin() + first;
+    if (!std::is_sorted(begin, matches.end()))
+        std::sort(begin, matches.end());
+
+    return found.size();
+}
@@ -0,0 +1,132 @@
+#ifndef _GLOB_EXPANDER_H_
+#define _GLOB_EXPANDER_H_
+
+#include "directory_cache.h"
+#include "tools.h"
+#include <bitset>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ *@brief A pattern matching one file name: `*`, `?` and `[...]`
+ *
+ * The pattern is compiled once into a list of steps, and a name is matched
+ * by walking them with a single backtracking point for the last `*`, so a
+ * name is never matched in more than quadratic time.
+ */
+class GlobPattern
+{
+private:
+    enum STEP_TYPE {
+        STEP_CHARACTER, /* A literal character */
+        STEP_ANY,       /* ? */
+        STEP_STAR,      /* * */
+        STEP_CLASS      /* [...], [!...] */
+    };
+
+    struct Step
+    {
+        int    type;
+        char   ch    = 0; /* The character of STEP_CHARACTER */
+        size_t klass = 0; /* The index in `classes` of STEP_CLASS */
+    };
+
+    std::vector<Step>             steps;
+    std::vector<std::bitset<256>> classes;
+    std::string                   prefix;    /* The characters before a wildcard */
+    bool                          wildcards = false;
+
+    /**
+     *@brief Compile a bracket expression
+     *
+     * @param pattern the pattern
+     * @param position the offset after the `[`, moved after the `]`
+     * @return false if it is not closed, the `[` is then a character
+     */
+    bool CompileClass(std::string_view pattern, size_t & position);
+
+public:
+    /**
+     *@param pattern the pattern, a `\` makes the next character literal
+     */
+    explicit GlobPattern(std::string_view pattern);
+    ~GlobPattern() {}
+
+    /**
+     *@brief Check whether a name matches the whole pattern
+     */
+    bool Match(std::string_view name) const;
+
+    /**
+     *@brief Check whether the pattern has a wildcard, or only characters
+     */
+    bool HasWildcards() const { return wildcards; }
+
+    /**
+     *@brief Get the characters every match starts with
+     */
+    const std::string & Prefix() const { return prefix; }
+};
+
+/**
+ *@brief Expand the patterns of a command line into the matching paths
+ *
+ * Each directory is read once per expander, however many patterns of the
+ * line go through it. A wildcard component only looks at the entries with
+ * its literal prefix, found by a binary search in the sorted listing, so
+ * `x*` in a directory of 100k entries does not look at all of them.
+ * `**` matches any number of directories, without following links.
+ */
+class GlobExpander
+{
+private:
+    std::unordered_map<std::string, std::vector<DirectoryEntry>, StringHash,
+                       std::equal_to<>>
+        listings; /* Empty for a directory that cannot be read */
+
+    /**
+     *@brief Get the entries of a directory, read the first time only
+     *
+     * @param path the directory as written in the pattern, empty for `.`
+     */
+    const std::vector<DirectoryEntry> & List(const std::string & path);
+
+    /**
+     *@brief Match the components from `component` on under a directory
+     *
+     * @param components the components of the pattern
+     * @param component the component to match
+     * @param path the directory matched so far, ending with `/` unless empty
+     * @param directories_only whether the pattern ends with `/`
+     * @param buffer the matched paths, each followed by a '\0'
+     * @param found the offsets of the matched paths in the buffer
+     */
+    void Walk(const std::vector<std::string_view> & components,
+              size_t component, std::string & path, bool directories_only,
+              std::string & buffer, std::vector<size_t> & found);
+
+public:
+    GlobExpander() {}
+    ~GlobExpander() {}
+
+    GlobExpander(const GlobExpander &)             = delete;
+    GlobExpander & operator=(const GlobExpander &) = delete;
+
+    /**
+     *@brief Expand a pattern into the paths matching it, sorted
+     *
+     * The names starting with `.` only match a component starting with `.`.
+     *
+     * @param pattern the pattern, a `\` makes the next character literal
+     * @param buffer where the paths are written, each followed by a '\0';
+     * it must not change while the views are used
+     * @param matches where the paths are appended
+     * @return size_t the number of paths appended, 0 if none matched
+     */
+    size_t Expand(std::string_view pattern, std::string & buffer,
+                  std::vector<std::string_view> & matches);
+};
+
+#endif // !_GLOB_EXPANDER_H_
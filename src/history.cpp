@@ -0,0 +1,206 @@
+#include "history.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+std::string History::DefaultFile()
+{
+    if (const char * file = getenv("HISTFILE"))
+        return file;
+
+    const char * home = getenv("HOME");
+    if (!home || !*home)
+        return "";
+
+    return std::string(home) + "/.shell_history";
+}
+
+void History::Open(const std::string & file)
+{
+    Close();
+    if (file.empty())
+        return;
+
+    append_fd = open(file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                     0600);
+
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return;
+
+    struct stat status;
+    if (fstat(fd, &status) == 0 && status.st_size > 0)
+    {
+        void * map =
+            mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            mapping      = static_cast<const char *>(map);
+            mapping_size = status.st_size;
+        }
+    }
+    close(fd);
+
+    // The entries are the lines of the mapping, used in place
+    for (size_t begin = 0; begin < mapping_size;)
+    {
+        const char * newline = static_cast<const char *>(
+            std::memchr(mapping + begin, '\n', mapping_size - begin));
+        size_t end = newline ? newline - mapping : mapping_size;
+
+        if (end > begin)
+            entries.emplace_back(mapping + begin, end - begin);
+        begin = end + 1;
+    }
+
+    return;
+}
+
+void History::Close()
+{
+    Clear();
+
+    if (append_fd != -1)
+        close(append_fd);
+    append_fd = -1;
+
+    return;
+}
+
+void History::Clear()
+{
+    entries.clear();
+    added.clear();
+    filters.clear();
+    indexed = 0;
+
+    if (mapping)
+        munmap(const_cast<char *>(mapping), mapping_size);
+    mapping      = nullptr;
+    mapping_size = 0;
+
+    return;
+}
+
+void History::Add(std::string_view line)
+{
+    while (!line.empty())
+    {
+        size_t           end  = std::min(line.find('\n'), line.size());
+        std::string_view part = line.substr(0, end);
+        line.remove_prefix(std::min(end + 1, line.size()));
+
+        // Blank lines are not worth remembering
+        if (part.find_first_not_of(" \t") == std::string_view::npos)
+            continue;
+
+        std::string & entry = added.emplace_back(part);
+        entries.emplace_back(entry);
+
+        // A single write, so the line is never interleaved with another
+        // shell; the entry is left alone, the view above points into it
+        if (append_fd != -1)
+        {
+            char  new_line  = '\n';
+            iovec parts[2] = {{entry.data(), entry.size()}, {&new_line, 1}};
+            if (writev(append_fd, parts, 2) == -1)
+            {
+                // Keep the history in memory only
+                close(append_fd);
+                append_fd = -1;
+            }
+        }
+    }
+
+    return;
+}
+
+size_t History::TrigramBit(const char * trigram)
+{
+    uint32_t value = static_cast<uint8_t>(trigram[0]) |
+                     static_cast<uint8_t>(trigram[1]) << 8 |
+                     static_cast<uint8_t>(trigram[2]) << 16;
+
+    // Fibonacci hashing, the top bits are the best mixed
+    return (value * 2654435761u) >> (32 - 11);
+}
+
+void History::BuildIndex()
+{
+    indexed = entries.size();
+    filters.assign((indexed + BLOCK_ENTRIES - 1) / BLOCK_ENTRIES * FILTER_WORDS,
+                   0);
+
+    for (size_t i = 0; i < indexed; i++)
+    {
+        uint64_t * filter = filters.data() + i / BLOCK_ENTRIES * FILTER_WORDS;
+        for (size_t p = 0; p + 3 <= entries[i].size(); p++)
+        {
+            size_t bit = TrigramBit(entries[i].data() + p);
+            filter[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+    }
+
+    return;
+}
+
+std::optional<size_t> History::Search(std::string_view query, size_t before)
+{
+    if (query.empty())
+        return std::nullopt;
+
+    before        = std::min(before, entries.size());
+    auto contains = [&](size_t i) {
+        return entries[i].find(query) != std::string_view::npos;
+    };
+
+    // Too short for a trigram, the newest entries usually match anyway
+    if (query.size() < 3)
+    {
+        for (size_t i = before; i-- > 0;)
+            if (contains(i))
+                return i;
+        return std::nullopt;
+    }
+
+    if (filters.empty() && !entries.empty())
+        BuildIndex();
+
+    // The entries added since the index was built are few, check them all
+    for (size_t i = before; i-- > indexed;)
+        if (contains(i))
+            return i;
+    before = std::min(before, indexed);
+
+    uint64_t mask[FILTER_WORDS] = {};
+    for (size_t p = 0; p + 3 <= query.size(); p++)
+    {
+        size_t bit = TrigramBit(query.data() + p);
+        mask[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+
+    // Go back block by block, skipping the ones missing a trigram
+    for (size_t block = (before + BLOCK_ENTRIES - 1) / BLOCK_ENTRIES;
+         block-- > 0;)
+    {
+        const uint64_t * filter = filters.data() + block * FILTER_WORDS;
+        bool             candidate = true;
+        for (size_t w = 0; w < FILTER_WORDS && candidate; w++)
+            candidate = (filter[w] & mask[w]) == mask[w];
+        if (!candidate)
+            continue;
+
+        size_t first = block * BLOCK_ENTRIES;
+        for (size_t i = std::min(before, first + BLOCK_ENTRIES); i-- > first;)
+            if (contains(i))
+                return i;
+    }
+
+    return std::nullopt;
+}
@@ -0,0 +1,96 @@
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ *@brief The command history, shared by the shells through one file
+ *
+ * The file is memory-mapped and its lines are used in place; only the lines
+ * entered in this session are stored as strings. Each new line is appended
+ * with a single `write()` on an `O_APPEND` descriptor, so concurrent shells
+ * never overwrite each other. Substring searches go through a trigram index
+ * that is built the first time a search needs it.
+ */
+class History
+{
+private:
+    const char *                  mapping      = nullptr;
+    size_t                        mapping_size = 0;
+    std::deque<std::string>       added; /* The lines of this session */
+    std::vector<std::string_view> entries;
+    int                           append_fd = -1;
+
+    /**
+     * The index splits the entries into blocks and keeps, for each block, a
+     * Bloom filter of the trigrams of its entries. A search only looks into
+     * the blocks whose filter has every trigram of the query.
+     */
+    static constexpr size_t BLOCK_ENTRIES = 32;
+    static constexpr size_t FILTER_WORDS  = 32; /* 2048 bits per block */
+    std::vector<uint64_t>   filters;
+    size_t                  indexed = 0; /* The entries in the index */
+
+    /**
+     *@brief Hash a trigram to a bit of a filter
+     */
+    static size_t TrigramBit(const char * trigram);
+
+    /**
+     *@brief Index the trigrams of all the entries
+     */
+    void BuildIndex();
+
+public:
+    History() {}
+    ~History() { Close(); }
+
+    History(const History &)             = delete;
+    History & operator=(const History &) = delete;
+
+    /**
+     *@brief Get the default history file
+     *
+     * It is `$HISTFILE` if set, which may be empty to keep no file, or
+     * `.shell_history` in the home directory.
+     */
+    static std::string DefaultFile();
+
+    /**
+     *@brief Load the history file and append the new lines to it
+     *
+     * @param file the path of the file, empty to keep the history in memory
+     */
+    void Open(const std::string & file);
+
+    void Close();
+
+    /**
+     *@brief Add a line entered by the user, each line of a paste separately
+     */
+    void Add(std::string_view line);
+
+    /**
+     *@brief Forget the entries, the file is left as it is
+     */
+    void Clear();
+
+    size_t           Size() const { return entries.size(); }
+    std::string_view Entry(size_t i) const { return entries[i]; }
+
+    /**
+     *@brief Find the newest entry containing a text
+     *
+     * @param query the text to search
+     * @param before only the entries before this one are searched
+     * @return std::optional<size_t> the entry, if any
+     */
+    std::optional<size_t> Search(std::string_view query, size_t before);
+};
+
+#endif // !_HISTORY_H_
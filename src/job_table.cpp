@@ -0,0 +1,395 @@
+#include "job_table.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iomanip>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int Job::State() const
+{
+    bool running = false, stopped = false;
+    for (const Process & process : processes)
+    {
+        running |= process.state == PROCESS_STATE::RUNNING;
+        stopped |= process.state == PROCESS_STATE::STOPPED;
+    }
+
+    return running   ? PROCESS_STATE::RUNNING
+           : stopped ? PROCESS_STATE::STOPPED
+                     : PROCESS_STATE::DONE;
+}
+
+JobTable::~JobTable()
+{
+    if (signal_fd != -1)
+        close(signal_fd);
+}
+
+void JobTable::Open()
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+
+    // SIGCHLD is only read from the signalfd
+    sigprocmask(SIG_BLOCK, &signals, nullptr);
+    signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    return;
+}
+
+bool JobTable::EnableJobControl(int fd)
+{
+    if (!isatty(fd))
+        return false;
+
+    // Wait until the shell runs in the foreground
+    pid_t group;
+    while (tcgetpgrp(fd) != (group = getpgrp()))
+        kill(-group, SIGTTIN);
+
+    // The keyboard signals are for the foreground job only
+    for (int signal : {SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU})
+        std::signal(signal, SIG_IGN);
+
+    // A session leader already leads its group
+    setpgid(0, 0);
+    shell_group = getpgrp();
+    if (tcsetpgrp(fd, shell_group) == -1 || tcgetattr(fd, &shell_modes) == -1)
+        return false;
+
+    terminal_fd = fd;
+    job_control = true;
+
+    return true;
+}
+
+void JobTable::EnterSubshell()
+{
+    jobs.clear();
+    recent.clear();
+    terminal_fd = -1;
+    job_control = false;
+
+    signal_fd = -1;
+    Open();
+
+    return;
+}
+
+void JobTable::MakeCurrent(int id)
+{
+    std::erase(recent, id);
+    recent.insert(recent.begin(), id);
+
+    return;
+}
+
+Job & JobTable::Add(std::string command, pid_t group,
+                    const std::vector<pid_t> & pids, bool background)
+{
+    int   id  = jobs.empty() ? 1 : jobs.rbegin()->first + 1;
+    Job & job = jobs[id];
+
+    job.id      = id;
+    job.group   = group;
+    job.command = std::move(command);
+    for (pid_t pid : pids)
+    {
+        Job::Process process;
+        process.pid = pid;
+        job.processes.push_back(process);
+    }
+
+    // A foreground job only becomes current once it stops
+    if (background)
+        MakeCurrent(id);
+
+    return job;
+}
+
+void JobTable::Remove(int id)
+{
+    jobs.erase(id);
+    std::erase(recent, id);
+
+    return;
+}
+
+void JobTable::Update(Job::Process & process, int status,
+                      const rusage & usage)
+{
+    if (WIFEXITED(status) || WIFSIGNALED(status))
+    {
+        process.usage    = usage;
+        process.finished = std::chrono::steady_clock::now();
+    }
+
+    if (WIFEXITED(status))
+    {
+        process.state    = PROCESS_STATE::DONE;
+        process.status   = WEXITSTATUS(status);
+        process.signaled = false;
+    }
+    else if (WIFSIGNALED(status))
+    {
+        process.state    = PROCESS_STATE::DONE;
+        process.status   = 128 + WTERMSIG(status);
+        process.signaled = true;
+    }
+    else if (WIFSTOPPED(status))
+    {
+        process.state    = PROCESS_STATE::STOPPED;
+        process.status   = 128 + WSTOPSIG(status);
+        process.signaled = true;
+    }
+    else if (WIFCONTINUED(status))
+        process.state = PROCESS_STATE::RUNNING;
+
+    return;
+}
+
+void JobTable::Reap()
+{
+    // Signals of the same kind merge, so only the fact that one came counts
+    signalfd_siginfo events[16];
+    while (signal_fd != -1 && read(signal_fd, events, sizeof(events)) > 0)
+        continue;
+
+    for (auto & [id, job] : jobs)
+    {
+        int previous_state = job.State();
+
+        for (Job::Process & process : job.processes)
+        {
+            int    status = 0;
+            pid_t  pid    = 0;
+            rusage usage  = {};
+            while (process.state != PROCESS_STATE::DONE &&
+                   ((pid = wait4(process.pid, &status,
+                                 WNOHANG | WUNTRACED | WCONTINUED, &usage)) >
+                        0 ||
+                    (pid == -1 && errno == EINTR)))
+                if (pid > 0)
+                    Update(process, status, usage);
+
+            // Reaped elsewhere, it is gone all the same
+            if (pid == -1 && errno == ECHILD)
+                process.state = PROCESS_STATE::DONE;
+        }
+
+        int state = job.State();
+        if (state != previous_state && state != PROCESS_STATE::RUNNING)
+            job.changed = true;
+    }
+
+    return;
+}
+
+void JobTable::WaitWhileRunning(Job & job)
+{
+    Reap();
+
+    while (job.State() == PROCESS_STATE::RUNNING)
+    {
+        // Without the signalfd, block on the first running child instead
+        if (signal_fd == -1)
+        {
+            auto process = std::find_if(
+                job.processes.begin(), job.processes.end(),
+                [](const Job::Process & p) {
+                    return p.state == PROCESS_STATE::RUNNING;
+                });
+            int    status = 0;
+            rusage usage  = {};
+            if (wait4(process->pid, &status, WUNTRACED, &usage) == process->pid)
+                Update(*process, status, usage);
+            else if (errno == ECHILD)
+                process->state = PROCESS_STATE::DONE;
+            continue;
+        }
+
+        pollfd event = {signal_fd, POLLIN, 0};
+        if (poll(&event, 1, -1) == -1 && errno != EINTR)
+            break;
+        Reap();
+    }
+
+    return;
+}
+
+void JobTable::Foreground(Job & job, bool resume)
+{
+    if (job_control && job.group > 0)
+    {
+        tcsetpgrp(terminal_fd, job.group);
+        if (resume && job.has_modes)
+            tcsetattr(terminal_fd, TCSADRAIN, &job.modes);
+    }
+
+    if (resume)
+    {
+        for (Job::Process & process : job.processes)
+            if (process.state == PROCESS_STATE::STOPPED)
+                process.state = PROCESS_STATE::RUNNING;
+        Signal(job, SIGCONT);
+    }
+
+    WaitWhileRunning(job);
+
+    // Only a stopped foreground job is reported
+    job.changed = job.State() == PROCESS_STATE::STOPPED;
+
+    if (job_control)
+    {
+        if (job.changed)
+            job.has_modes = tcgetattr(terminal_fd, &job.modes) == 0;
+        tcsetpgrp(terminal_fd, shell_group);
+        tcsetattr(terminal_fd, TCSADRAIN, &shell_modes);
+    }
+    if (job.changed)
+        MakeCurrent(job.id);
+
+    return;
+}
+
+void JobTable::Background(Job & job)
+{
+    for (Job::Process & process : job.processes)
+        if (process.state == PROCESS_STATE::STOPPED)
+            process.state = PROCESS_STATE::RUNNING;
+
+    job.changed = false;
+    Signal(job, SIGCONT);
+
+    return;
+}
+
+bool JobTable::Wait(Job & job)
+{
+    WaitWhileRunning(job);
+
+    return job.State() == PROCESS_STATE::DONE;
+}
+
+bool JobTable::Signal(Job & job, int signal)
+{
+    if (job.group > 0)
+        return kill(-job.group, signal) == 0;
+
+    bool sent = false;
+    for (const Job::Process & process : job.processes)
+        if (process.state != PROCESS_STATE::DONE)
+            sent |= kill(process.pid, signal) == 0;
+
+    return sent;
+}
+
+Job * JobTable::Find(std::string_view spec)
+{
+    if (!spec.starts_with('%'))
+        return nullptr;
+    spec.remove_prefix(1);
+
+    int id = 0;
+    if (spec.empty() || spec == "%" || spec == "+")
+        id = recent.empty() ? 0 : recent[0];
+    else if (spec == "-")
+        id = recent.size() > 1 ? recent[1] : recent.empty() ? 0 : recent[0];
+    else if (spec.find_first_not_of("0123456789") == std::string_view::npos)
+        for (char digit : spec)
+            id = std::min(id * 10 + (digit - '0'), 1 << 24);
+    else
+    {
+        // `%?text` is in the command, `%text` starts it; it must be one job
+        bool anywhere = spec.starts_with('?');
+        if (anywhere)
+            spec.remove_prefix(1);
+
+        Job * found = nullptr;
+        for (auto & [job_id, job] : jobs)
+            if (anywhere ? job.command.find(spec) != std::string::npos
+                         : job.command.starts_with(spec))
+            {
+                if (found)
+                    return nullptr;
+                found = &job;
+            }
+        return found;
+    }
+
+    auto iter = jobs.find(id);
+    return iter == jobs.end() ? nullptr : &iter->second;
+}
+
+Job * JobTable::FindByPid(pid_t pid)
+{
+    for (auto & [id, job] : jobs)
+        for (const Job::Process & process : job.processes)
+            if (process.pid == pid)
+                return &job;
+
+    return nullptr;
+}
+
+void JobTable::Print(std::ostream & out, const Job & job, bool with_pids) const
+{
+    char mark = ' ';
+    if (!recent.empty() && recent[0] == job.id)
+        mark = '+';
+    else if (recent.size() > 1 && recent[1] == job.id)
+        mark = '-';
+
+    std::string state;
+    switch (job.State())
+    {
+    case PROCESS_STATE::RUNNING:
+        state = "Running";
+        break;
+
+    case PROCESS_STATE::STOPPED:
+        state = "Stopped";
+        break;
+
+    default: /* Done, like the last process */
+        const Job::Process & last = job.processes.back();
+        if (last.signaled)
+            state = strsignal(last.status - 128);
+        else if (last.status != 0)
+            state = "Exit " + std::to_string(last.status);
+        else
+            state = "Done";
+        break;
+    }
+
+    out << '[' << job.id << ']' << mark << ' ';
+    if (with_pids)
+        out << job.processes.front().pid << ' ';
+    out << ' ' << std::left << std::setw(24) << state << job.command
+        << (job.State() == PROCESS_STATE::RUNNING ? " &" : "") << '\n';
+
+    return;
+}
+
+void JobTable::Report(std::ostream & out)
+{
+    for (auto iter = jobs.begin(); iter != jobs.end();)
+    {
+        Job & job = iter->second;
+        ++iter;
+
+        if (!job.changed)
+            continue;
+
+        Print(out, job, false);
+        job.changed = false;
+        if (job.State() == PROCESS_STATE::DONE)
+            Remove(job.id);
+    }
+
+    return;
+}
@@ -0,0 +1,214 @@
+#ifndef _JOB_TABLE_H_
+#define _JOB_TABLE_H_
+
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <termios.h>
+#include <vector>
+
+enum PROCESS_STATE { RUNNING, STOPPED, DONE };
+
+/**
+ *@brief The children started by one pipeline
+ */
+struct Job
+{
+    struct Process
+    {
+        pid_t pid;
+        int   state    = PROCESS_STATE::RUNNING;
+        int   status   = 0; /* The exit status, or 128 + the signal number */
+        bool  signaled = false; /* Killed or stopped by the signal */
+        rusage usage   = {};    /* What it used, once done */
+        std::chrono::steady_clock::time_point finished; /* Once done */
+    };
+
+    int                  id    = 0;
+    pid_t                group = -1; /* The process group, -1 without job control */
+    std::string          command;
+    std::vector<Process> processes; /* In the order of the pipeline */
+    bool                 changed = false; /* Stopped or done since reported */
+    termios              modes   = {};    /* The terminal modes it stopped with */
+    bool                 has_modes = false;
+
+    /**
+     *@brief Get the state of the job from the states of its processes
+     *
+     * It is done once they are all done, and stopped once none runs.
+     */
+    int State() const;
+
+    /**
+     *@brief Get the status of the last process
+     */
+    int Status() const { return processes.back().status; }
+};
+
+/**
+ *@brief The jobs of the shell and the reaper of their processes
+ *
+ * SIGCHLD is blocked and read from a signalfd, so a child changing state
+ * is an event the shell can wait for, together with the terminal, instead of
+ * blocking in `waitpid()` on one child. On each event, only the known
+ * children are checked with `wait4(WNOHANG)`, so no other child is ever
+ * reaped behind its owner's back.
+ *
+ * With job control, in an interactive shell, each job has its own process
+ * group and the foreground job owns the terminal.
+ */
+class JobTable
+{
+private:
+    std::map<int, Job> jobs;   /* By id */
+    std::vector<int>   recent; /* The ids, the current job `%+` first */
+    int                signal_fd   = -1;
+    int                terminal_fd = -1;
+    pid_t              shell_group = -1;
+    termios            shell_modes = {}; /* Restored when the shell takes the terminal */
+    bool               job_control = false;
+
+    /**
+     *@brief Make a job the current one
+     */
+    void MakeCurrent(int id);
+
+    /**
+     *@brief Record a status and the resource usage returned by `wait4()`
+     */
+    static void Update(Job::Process & process, int status,
+                       const rusage & usage);
+
+    /**
+     *@brief Wait until the job stops or is done
+     */
+    void WaitWhileRunning(Job & job);
+
+public:
+    JobTable() {}
+    ~JobTable();
+
+    JobTable(const JobTable &)             = delete;
+    JobTable & operator=(const JobTable &) = delete;
+
+    /**
+     *@brief Block SIGCHLD and open the signalfd the children are reaped by
+     *
+     * It must run before any thread starts, so they all keep it blocked.
+     */
+    void Open();
+
+    /**
+     *@brief Take the terminal and put the shell in its own process group
+     *
+     * The shell then ignores the keyboard signals; the children get them
+     * back.
+     *
+     * @param fd the terminal
+     * @return false if the shell cannot own the terminal
+     */
+    bool EnableJobControl(int fd);
+
+    /**
+     *@brief Forget the jobs and the job control of the shell in a child
+     * forked to run commands, which waits for its own children
+     *
+     * The signalfd of the shell was closed with the close-on-exec fds, so
+     * a new one is opened.
+     */
+    void EnterSubshell();
+
+    bool HasJobControl() const { return job_control; }
+    int  TerminalFd() const { return terminal_fd; }
+
+    /**
+     *@brief The fd that is readable when a child changed state
+     */
+    int SignalFd() const { return signal_fd; }
+
+    bool Empty() const { return jobs.empty(); }
+
+    /**
+     *@brief Add a job for children just started
+     *
+     * @param command the text of the pipeline
+     * @param group the process group of the children, -1 for none
+     * @param pids the children, in the order of the pipeline
+     * @param background whether it runs in the background
+     * @return Job & the new job, the number after the greatest one
+     */
+    Job & Add(std::string command, pid_t group, const std::vector<pid_t> & pids,
+              bool background);
+
+    void Remove(int id);
+
+    /**
+     *@brief Read the pending events and update the children that changed
+     */
+    void Reap();
+
+    /**
+     *@brief Run a job in the foreground until it stops or is done
+     *
+     * The job gets the terminal and the shell takes it back afterwards, with
+     * its own modes; a stopped job keeps its modes for when it continues.
+     *
+     * @param job the job
+     * @param resume whether to send SIGCONT first
+     */
+    void Foreground(Job & job, bool resume);
+
+    /**
+     *@brief Continue a stopped job in the background
+     */
+    void Background(Job & job);
+
+    /**
+     *@brief Wait until a job is done, without giving it the terminal
+     *
+     * @return false if it stopped instead
+     */
+    bool Wait(Job & job);
+
+    /**
+     *@brief Send a signal to the processes of a job
+     *
+     * @return false if it could not be sent
+     */
+    bool Signal(Job & job, int signal);
+
+    /**
+     *@brief Find a job from `%n`, `%+`, `%%`, `%-`, `%prefix` or `%?text`
+     *
+     * @return Job * the job, nullptr if there is none or several
+     */
+    Job * Find(std::string_view spec);
+
+    /**
+     *@brief Find the job of a child
+     */
+    Job * FindByPid(pid_t pid);
+
+    std::map<int, Job> & GetJobs() { return jobs; }
+
+    /**
+     *@brief Print a job like `jobs` does
+     *
+     * @param out the stream
+     * @param job the job
+     * @param with_pids whether to show the pids of the processes
+     */
+    void Print(std::ostream & out, const Job & job, bool with_pids) const;
+
+    /**
+     *@brief Print the jobs that stopped or are done since the last report,
+     * then forget the done ones
+     */
+    void Report(std::ostream & out);
+};
+
+#endif // !_JOB_TABLE_H_
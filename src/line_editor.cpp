@@ -0,0 +1,755 @@
+#include "line_editor.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+bool    LineEditor::raw_mode      = false;
+termios LineEditor::original_mode = {};
+
+namespace
+{
+// Pastes come between `ESC [200~` and `ESC [201~` while it is on
+constexpr std::string_view BRACKETED_PASTE_ON  = "\x1b[?2004h";
+constexpr std::string_view BRACKETED_PASTE_OFF = "\x1b[?2004l";
+
+constexpr char ctrl(char ch) { return ch & 0x1f; }
+
+bool isPlain(char ch)
+{
+    return static_cast<unsigned char>(ch) >= 0x20 && ch != 127;
+}
+
+bool isContinuation(char ch) { return (ch & 0xc0) == 0x80; }
+
+/**
+ *@brief Check whether an escape sequence, starting with ESC, is complete
+ */
+bool isCompleteEscape(std::string_view sequence)
+{
+    if (sequence.size() < 2)
+        return false;
+
+    // CSI: parameters and intermediates, then a final byte
+    if (sequence[1] == '[')
+        return sequence.size() > 2 && sequence.back() >= 0x40 &&
+               sequence.back() <= 0x7e;
+
+    // SS3, as sent for the arrows in application mode
+    if (sequence[1] == 'O')
+        return sequence.size() == 3;
+
+    return true; /* Alt and a key */
+}
+} // namespace
+
+void LineEditor::RestoreAtExit()
+{
+    Suspend();
+
+    return;
+}
+
+void LineEditor::EnterRawMode()
+{
+    static bool registered = false;
+
+    if (raw_mode || tcgetattr(STDIN_FILENO, &original_mode) != 0)
+        return;
+
+    // `exit` does not unwind to the destructor
+    if (!registered)
+        std::atexit(RestoreAtExit);
+    registered = true;
+
+    // Read byte by byte without echo, the control keys are handled here
+    termios raw = original_mode;
+    raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+    raw.c_iflag &= ~IXON;
+    raw.c_cc[VMIN]  = 1;
+    raw.c_cc[VTIME] = 0;
+
+    if (tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) == 0)
+        raw_mode = true;
+
+    return;
+}
+
+void LineEditor::Suspend()
+{
+    if (!raw_mode)
+        return;
+
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &original_mode);
+    raw_mode = false;
+
+    return;
+}
+
+void LineEditor::UpdateColumns()
+{
+    winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0)
+    {
+        columns = size.ws_col;
+        rows    = size.ws_row > 0 ? size.ws_row : rows;
+    }
+
+    return;
+}
+
+size_t LineEditor::Width(std::string_view text)
+{
+    size_t width = 0;
+    for (char ch : text)
+        if (!isContinuation(ch))
+            width++;
+
+    return width;
+}
+
+size_t LineEditor::PreviousCharacter(size_t position) const
+{
+    if (position == 0)
+        return 0;
+
+    do position--;
+    while (position > 0 && isContinuation(line[position]));
+
+    return position;
+}
+
+size_t LineEditor::NextCharacter(size_t position) const
+{
+    if (position >= line.size())
+        return line.size();
+
+    do position++;
+    while (position < line.size() && isContinuation(line[position]));
+
+    return position;
+}
+
+size_t LineEditor::PreviousWord(size_t position) const
+{
+    while (position > 0 && line[position - 1] == ' ') position--;
+    while (position > 0 && line[position - 1] != ' ') position--;
+
+    return position;
+}
+
+size_t LineEditor::NextWord(size_t position) const
+{
+    while (position < line.size() && line[position] == ' ') position++;
+    while (position < line.size() && line[position] != ' ') position++;
+
+    return position;
+}
+
+void LineEditor::Insert(std::string_view text)
+{
+    bool at_end = (cursor == line.size());
+
+    line.insert(cursor, text);
+    cursor += text.size();
+
+    // Typing at the end only needs an echo, unless it stops at the margin
+    if (at_end && !dirty)
+    {
+        size_t total = Width(prompt) + Width(line);
+        if (total % columns != 0)
+        {
+            output.append(text);
+            cursor_row = total / columns;
+            return;
+        }
+    }
+
+    dirty = true;
+
+    return;
+}
+
+void LineEditor::Erase(size_t begin, size_t end)
+{
+    if (begin >= end)
+        return;
+
+    line.erase(begin, end - begin);
+    cursor = begin;
+    dirty  = true;
+
+    return;
+}
+
+void LineEditor::MoveCursor(size_t position)
+{
+    if (position == cursor)
+        return;
+
+    cursor = position;
+    dirty  = true;
+
+    return;
+}
+
+void LineEditor::Replace(size_t begin, size_t end, std::string_view text)
+{
+    line.replace(begin, end - begin, text);
+    cursor = begin + text.size();
+    dirty  = true;
+
+    return;
+}
+
+void LineEditor::Refresh()
+{
+    size_t prompt_width = Width(prompt);
+    size_t total        = prompt_width + Width(line);
+    size_t target =
+        prompt_width + Width(std::string_view(line).substr(0, cursor));
+
+    // Go back to the first row and draw everything again
+    if (cursor_row > 0)
+        output.append("\x1b[" + std::to_string(cursor_row) + "A");
+    output.push_back('\r');
+    output.append(prompt);
+    output.append(line);
+    output.append("\x1b[J");
+
+    // The terminal waits at the margin instead of wrapping, wrap it now
+    if (total % columns == 0)
+        output.append("\r\n");
+
+    // Then move up and right to the cursor
+    size_t end_row    = total / columns;
+    size_t target_row = target / columns;
+    if (end_row > target_row)
+        output.append("\x1b[" + std::to_string(end_row - target_row) + "A");
+    output.push_back('\r');
+    if (target % columns > 0)
+        output.append("\x1b[" + std::to_string(target % columns) + "C");
+
+    cursor_row = target_row;
+    dirty      = false;
+
+    return;
+}
+
+void LineEditor::FinishLine()
+{
+    if (dirty || cursor != line.size())
+    {
+        cursor = line.size();
+        Refresh();
+    }
+
+    // Refresh() has already wrapped a line that ends at the margin
+    if ((Width(prompt) + Width(line)) % columns != 0)
+        output.append("\r\n");
+    cursor_row = 0;
+
+    return;
+}
+
+void LineEditor::ShowList(std::vector<std::string> items)
+{
+    size_t position = cursor;
+    FinishLine();
+    cursor = position;
+
+    listing       = std::move(items);
+    listing_next  = 0;
+    listing_width = 0;
+    for (const std::string & item : listing)
+        listing_width = std::max(listing_width, Width(item));
+    listing_width += 2;
+
+    ShowPage(rows > 1 ? rows - 1 : 1);
+
+    return;
+}
+
+void LineEditor::ShowPage(size_t row_count)
+{
+    size_t per_row = std::max<size_t>(1, columns / listing_width);
+
+    for (size_t row = 0; row < row_count && listing_next < listing.size();
+         row++)
+    {
+        for (size_t column = 0;
+             column < per_row && listing_next < listing.size(); column++)
+        {
+            const std::string & item = listing[listing_next++];
+            output.append(item);
+            if (column + 1 < per_row && listing_next < listing.size())
+                output.append(listing_width - Width(item), ' ');
+        }
+        output.append("\r\n");
+    }
+
+    if (listing_next < listing.size())
+    {
+        paging = true;
+        output.append("--More-- (" +
+                      std::to_string(listing.size() - listing_next) +
+                      " left)");
+    }
+    else
+        EndList();
+
+    return;
+}
+
+bool LineEditor::HandlePagerKey(char ch)
+{
+    output.append("\r\x1b[K"); /* Erase `--More--` */
+
+    switch (ch)
+    {
+    case ' ':
+        ShowPage(rows > 1 ? rows - 1 : 1);
+        return true;
+
+    case '\r':
+    case '\n':
+        ShowPage(1);
+        return true;
+
+    case 'q':
+    case 'Q':
+    case ctrl('C'):
+    case ctrl('G'):
+        EndList();
+        return true;
+
+    default: /* The key is handled by the editor */
+        EndList();
+        return false;
+    }
+}
+
+void LineEditor::EndList()
+{
+    paging = false;
+    listing.clear();
+    listing_next = 0;
+
+    // The prompt is drawn again under the list
+    cursor_row = 0;
+    dirty      = true;
+
+    return;
+}
+
+void LineEditor::Flush()
+{
+    size_t written = 0;
+    while (written < output.size())
+    {
+        ssize_t n = write(STDOUT_FILENO, output.data() + written,
+                          output.size() - written);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        written += n;
+    }
+    output.clear();
+
+    return;
+}
+
+int LineEditor::HandleControl(char ch)
+{
+    switch (ch)
+    {
+    case '\r':
+    case '\n':
+        return 1;
+
+    case ctrl('D'): /* The end of input on an empty line, delete otherwise */
+        if (line.empty())
+            return -1;
+        Erase(cursor, NextCharacter(cursor));
+        break;
+
+    case 127:
+    case ctrl('H'):
+        if (cursor == 0)
+            break;
+
+        // Erasing the last character in the middle of a row is just an echo
+        if (!dirty && cursor == line.size() &&
+            static_cast<unsigned char>(line.back()) < 0x80 &&
+            (Width(prompt) + Width(line)) % columns != 0)
+        {
+            line.pop_back();
+            cursor--;
+            output.append("\b \b");
+            break;
+        }
+        Erase(PreviousCharacter(cursor), cursor);
+        break;
+
+    case ctrl('A'):
+        MoveCursor(0);
+        break;
+    case ctrl('E'):
+        MoveCursor(line.size());
+        break;
+    case ctrl('B'):
+        MoveCursor(PreviousCharacter(cursor));
+        break;
+    case ctrl('P'):
+        MoveInHistory(-1);
+        break;
+    case ctrl('N'):
+        MoveInHistory(1);
+        break;
+    case ctrl('R'):
+        StartSearch();
+        break;
+    case ctrl('F'):
+        MoveCursor(NextCharacter(cursor));
+        break;
+
+    case ctrl('K'):
+        Erase(cursor, line.size());
+        break;
+    case ctrl('U'):
+        Erase(0, cursor);
+        break;
+    case ctrl('W'):
+        Erase(PreviousWord(cursor), cursor);
+        break;
+
+    case ctrl('L'): /* Clear the screen, keep the line */
+        output.append("\x1b[H\x1b[2J");
+        cursor_row = 0;
+        dirty      = true;
+        break;
+
+    case ctrl('C'): /* Drop the line and start a new one */
+        cursor = line.size();
+        if (dirty)
+            Refresh();
+        output.append("^C\r\n");
+        line.clear();
+        cursor     = 0;
+        cursor_row = 0;
+        dirty      = true;
+        break;
+
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+void LineEditor::HandleEscape(std::string_view sequence)
+{
+    if (sequence == "[200~")
+        pasting = true;
+    else if (sequence == "[201~")
+        pasting = false;
+    else if (pasting) /* Keys are not interpreted in a paste */
+        return;
+    else if (sequence == "[A" || sequence == "OA")
+        MoveInHistory(-1);
+    else if (sequence == "[B" || sequence == "OB")
+        MoveInHistory(1);
+    else if (sequence == "[D" || sequence == "OD")
+        MoveCursor(PreviousCharacter(cursor));
+    else if (sequence == "[C" || sequence == "OC")
+        MoveCursor(NextCharacter(cursor));
+    else if (sequence == "[H" || sequence == "OH" || sequence == "[1~" ||
+             sequence == "[7~")
+        MoveCursor(0);
+    else if (sequence == "[F" || sequence == "OF" || sequence == "[4~" ||
+             sequence == "[8~")
+        MoveCursor(line.size());
+    else if (sequence == "[3~")
+        Erase(cursor, NextCharacter(cursor));
+    else if (sequence == "b" || sequence == "[1;5D" || sequence == "[1;3D")
+        MoveCursor(PreviousWord(cursor));
+    else if (sequence == "f" || sequence == "[1;5C" || sequence == "[1;3C")
+        MoveCursor(NextWord(cursor));
+    else if (sequence == "d")
+        Erase(cursor, NextWord(cursor));
+    else if (sequence == "\x7f")
+        Erase(PreviousWord(cursor), cursor);
+
+    return;
+}
+
+void LineEditor::MoveInHistory(int direction)
+{
+    size_t size = history ? history->Size() : 0;
+    if ((direction < 0 && history_position == 0) ||
+        (direction > 0 && history_position >= size))
+    {
+        Bell();
+        return;
+    }
+
+    // Keep the line being typed to come back to it
+    if (history_position == size)
+        history_saved_line = line;
+
+    history_position += direction;
+    line   = history_position == size
+                 ? history_saved_line
+                 : std::string(history->Entry(history_position));
+    cursor = line.size();
+    dirty  = true;
+
+    return;
+}
+
+void LineEditor::StartSearch()
+{
+    if (!history)
+    {
+        Bell();
+        return;
+    }
+
+    searching              = true;
+    search_query.clear();
+    search_match           = history->Size();
+    search_original_line   = line;
+    search_original_cursor = cursor;
+    base_prompt            = prompt;
+    UpdateSearch(history->Size());
+
+    return;
+}
+
+void LineEditor::UpdateSearch(size_t before)
+{
+    std::optional<size_t> found = history->Search(search_query, before);
+    if (found)
+    {
+        search_match = *found;
+        line         = history->Entry(search_match);
+        cursor       = line.find(search_query);
+    }
+
+    bool failed = !found && !search_query.empty();
+    if (failed)
+        Bell();
+
+    // The prompt shows the query, the line shows the match
+    search_prompt = failed ? "(failed reverse-i-search)`"
+                           : "(reverse-i-search)`";
+    search_prompt.append(search_query).append("': ");
+    prompt = search_prompt;
+    dirty  = true;
+
+    return;
+}
+
+bool LineEditor::HandleSearchKey(char ch)
+{
+    switch (ch)
+    {
+    case ctrl('R'): /* The next older match */
+        if (!search_query.empty())
+            UpdateSearch(search_match);
+        return true;
+
+    case 127:
+    case ctrl('H'): /* Search the shorter query from the newest entry */
+        if (!search_query.empty())
+            search_query.pop_back();
+        search_match = history->Size();
+        UpdateSearch(history->Size());
+        return true;
+
+    case ctrl('G'):
+    case ctrl('C'):
+        EndSearch(false);
+        return true;
+
+    default: /* Any other key edits the match */
+        EndSearch(true);
+        return false;
+    }
+}
+
+void LineEditor::EndSearch(bool keep)
+{
+    searching = false;
+    prompt    = base_prompt;
+
+    if (keep && search_match < history->Size())
+        history_position = search_match;
+    else if (!keep)
+    {
+        line   = search_original_line;
+        cursor = search_original_cursor;
+    }
+    dirty = true;
+
+    return;
+}
+
+bool LineEditor::ReadLine(std::string_view prompt_text, std::string & result)
+{
+    std::cout.flush();
+    EnterRawMode();
+    UpdateColumns();
+
+    prompt = prompt_text;
+    line.clear();
+    cursor       = 0;
+    cursor_row   = 0;
+    dirty        = false;
+    pasting      = false;
+    last_was_tab = false;
+    searching    = false;
+    paging       = false;
+    escape.clear();
+    notified_line.clear();
+    notified_cursor  = 0;
+    history_position = history ? history->Size() : 0;
+
+    output.append(BRACKETED_PASTE_ON);
+    output.append(prompt);
+
+    // Keys typed ahead while the previous line ran come first
+    std::string input = std::move(typeahead);
+    typeahead.clear();
+
+    int state = 0; /* 1 once the line is accepted, -1 at the end of input */
+    while (state == 0)
+    {
+        if (input.empty())
+        {
+            Flush();
+
+            // Handle the events that come first, the keys wait in the tty
+            if (event_fd != -1)
+            {
+                pollfd events[2] = {{STDIN_FILENO, POLLIN, 0},
+                                    {event_fd, POLLIN, 0}};
+                if (poll(events, 2, -1) == -1)
+                {
+                    if (errno == EINTR)
+                        continue;
+                }
+                else if (events[1].revents & POLLIN)
+                {
+                    event_handler();
+                    continue;
+                }
+            }
+
+            char    buffer[4096];
+            ssize_t length = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (length == -1 && errno == EINTR)
+                continue;
+            if (length <= 0)
+            {
+                state = -1;
+                break;
+            }
+            input.assign(buffer, length);
+            UpdateColumns();
+        }
+
+        size_t i = 0;
+        while (i < input.size() && state == 0)
+        {
+            if (paging && escape.empty() && HandlePagerKey(input[i]))
+            {
+                i++;
+                continue;
+            }
+
+            // Insert a run of plain characters, or a whole paste, at once
+            size_t run = i;
+            if (escape.empty())
+                while (run < input.size() && input[run] != '\x1b' &&
+                       (pasting || isPlain(input[run])))
+                    run++;
+
+            if (run > i)
+            {
+                std::string text = input.substr(i, run - i);
+                if (pasting)
+                    for (char & ch : text)
+                        if (ch == '\r')
+                            ch = '\n';
+
+                if (searching) /* Typed into the query */
+                {
+                    search_query.append(text);
+                    UpdateSearch(std::min(search_match + 1, history->Size()));
+                }
+                else
+                    Insert(text);
+                last_was_tab = false;
+                i            = run;
+                continue;
+            }
+
+            char ch = input[i++];
+            bool tab = false;
+
+            if (searching && escape.empty() && HandleSearchKey(ch))
+                continue;
+
+            if (!escape.empty() || ch == '\x1b')
+            {
+                escape.push_back(ch);
+                if (isCompleteEscape(escape))
+                {
+                    HandleEscape(std::string_view(escape).substr(1));
+                    escape.clear();
+                }
+                continue;
+            }
+            else if (ch == '\t')
+            {
+                if (completer)
+                    completer(last_was_tab);
+                tab = true;
+            }
+            else
+                state = HandleControl(ch);
+
+            last_was_tab = tab;
+        }
+
+        // Keep what follows the accepted line for the next one
+        if (state != 0)
+            typeahead = input.substr(i);
+        input.clear();
+
+        if (state == 0 && dirty && !paging)
+            Refresh();
+
+        // The search shows matches, not what the user typed
+        if (state == 0 && change_handler && !searching &&
+            (cursor != notified_cursor || line != notified_line))
+        {
+            notified_line   = line;
+            notified_cursor = cursor;
+            change_handler();
+        }
+    }
+
+    FinishLine();
+    output.append(BRACKETED_PASTE_OFF);
+    Flush();
+
+    result = line;
+
+    return state == 1;
+}
@@ -0,0 +1,258 @@
+#ifndef _LINE_EDITOR_H_
+#define _LINE_EDITOR_H_
+
+#include "history.h"
+#include <functional>
+#include <string>
+#include <string_view>
+#include <termios.h>
+#include <vector>
+
+/**
+ *@brief An interactive line editor on a raw mode terminal
+ *
+ * The input is read in chunks with `read()`, so a paste or a burst of keys
+ * is handled as one batch, and everything the batch draws is composed into
+ * one buffer and written with a single `write()`. The terminal stays in raw
+ * mode between lines; it is only restored while a child runs.
+ */
+class LineEditor
+{
+public:
+    /**
+     *@brief Called when Tab is pressed
+     *
+     * @param repeated whether the previous key was Tab as well
+     */
+    using Completer = std::function<void(bool repeated)>;
+
+    /**
+     *@brief Called after a batch of keys changed the line or the cursor
+     */
+    using ChangeHandler = std::function<void()>;
+
+    /**
+     *@brief Called when the event fd is readable while a line is read
+     */
+    using EventHandler = std::function<void()>;
+
+private:
+    std::string      line;
+    size_t           cursor = 0;  /* The byte offset of the cursor */
+    std::string_view prompt;
+    std::string      output;      /* What the current batch draws */
+    std::string      escape;      /* An escape sequence split by a read */
+    std::string      typeahead;   /* Read after the last accepted line */
+    size_t           columns    = 80;
+    size_t           rows       = 24;
+    size_t           cursor_row = 0; /* The row of the cursor under the prompt */
+    bool             dirty      = false; /* The line must be redrawn */
+    bool             pasting    = false; /* Inside a bracketed paste */
+    bool             last_was_tab = false;
+    Completer        completer;
+    ChangeHandler    change_handler;
+    std::string      notified_line; /* The line the handler last saw */
+    size_t           notified_cursor = 0;
+    int              event_fd = -1;
+    EventHandler     event_handler;
+
+    History *        history = nullptr;
+    size_t           history_position = 0; /* The entry shown, or Size() */
+    std::string      history_saved_line;   /* The line before navigating */
+
+    // The state of Ctrl-R
+    bool             searching = false;
+    std::string      search_query;
+    std::string      search_prompt;
+    size_t           search_match = 0; /* The entry found, or Size() */
+    std::string_view base_prompt;      /* The prompt to restore */
+    std::string      search_original_line;
+    size_t           search_original_cursor = 0;
+
+    // The list shown a page at a time under the line
+    bool                     paging = false;
+    std::vector<std::string> listing;
+    size_t                   listing_next  = 0; /* The first item not shown */
+    size_t                   listing_width = 0; /* The width of a column */
+
+    static bool    raw_mode;
+    static termios original_mode; /* The mode to restore for the children */
+
+    static void RestoreAtExit();
+
+    void EnterRawMode();
+    void UpdateColumns();
+
+    /**
+     *@brief Count the columns of a text, one per UTF-8 character
+     */
+    static size_t Width(std::string_view text);
+
+    size_t PreviousCharacter(size_t position) const;
+    size_t NextCharacter(size_t position) const;
+    size_t PreviousWord(size_t position) const;
+    size_t NextWord(size_t position) const;
+
+    /**
+     *@brief Insert text at the cursor
+     *
+     * Typing at the end of the line only echoes the text, anything else
+     * redraws the line at the end of the batch.
+     */
+    void Insert(std::string_view text);
+
+    /**
+     *@brief Erase a range of the line and put the cursor at its start
+     */
+    void Erase(size_t begin, size_t end);
+
+    void MoveCursor(size_t position);
+
+    /**
+     *@brief Redraw the prompt and the line, which may wrap over several rows
+     */
+    void Refresh();
+
+    /**
+     *@brief Move the terminal cursor below the last row of the line
+     */
+    void FinishLine();
+
+    /**
+     *@brief Write the output of the batch at once
+     */
+    void Flush();
+
+    /**
+     *@brief Handle a control key
+     *
+     * @return int 1 if the line is accepted, -1 at the end of the input,
+     * 0 otherwise
+     */
+    int HandleControl(char ch);
+
+    /**
+     *@brief Handle a complete escape sequence
+     */
+    void HandleEscape(std::string_view sequence);
+
+    /**
+     *@brief Show the previous or the next history entry
+     *
+     * @param direction -1 for the previous entry, 1 for the next one
+     */
+    void MoveInHistory(int direction);
+
+    void StartSearch();
+
+    /**
+     *@brief Search the query in the entries before an entry
+     *
+     * The line keeps the last match if nothing is found.
+     */
+    void UpdateSearch(size_t before);
+
+    /**
+     *@brief Handle a key during a search
+     *
+     * @return true if the key was consumed by the search
+     */
+    bool HandleSearchKey(char ch);
+
+    /**
+     *@brief Show the next rows of the list, then `--More--` if any is left
+     */
+    void ShowPage(size_t row_count);
+
+    /**
+     *@brief Handle a key while `--More--` is shown
+     *
+     * @return true if the key was consumed by the pager
+     */
+    bool HandlePagerKey(char ch);
+
+    /**
+     *@brief Stop showing the list and draw the line again under it
+     */
+    void EndList();
+
+    /**
+     *@brief Leave the search
+     *
+     * @param keep whether to keep the match or restore the line
+     */
+    void EndSearch(bool keep);
+
+public:
+    LineEditor() {}
+    ~LineEditor() { Suspend(); }
+
+    LineEditor(const LineEditor &)             = delete;
+    LineEditor & operator=(const LineEditor &) = delete;
+
+    /**
+     *@brief Read a line from the terminal
+     *
+     * @param prompt_text the prompt
+     * @param result the line that was entered
+     * @return false at the end of the input
+     */
+    bool ReadLine(std::string_view prompt_text, std::string & result);
+
+    /**
+     *@brief Give the terminal back in the mode it had, before a child runs
+     */
+    static void Suspend();
+
+    /**
+     *@brief Navigate and search this history, nullptr for none
+     */
+    void SetHistory(History * new_history) { history = new_history; }
+
+    void SetCompleter(Completer new_completer)
+    {
+        completer = std::move(new_completer);
+    }
+
+    void SetChangeHandler(ChangeHandler new_change_handler)
+    {
+        change_handler = std::move(new_change_handler);
+    }
+
+    /**
+     *@brief Watch a fd together with the terminal, -1 for none
+     */
+    void SetEventHandler(int fd, EventHandler new_event_handler)
+    {
+        event_fd      = fd;
+        event_handler = std::move(new_event_handler);
+    }
+
+    /**
+     * The functions below are meant for the completer and the key handlers,
+     * while a line is being read
+     */
+
+    std::string_view Line() const { return line; }
+    size_t           Cursor() const { return cursor; }
+
+    /**
+     *@brief Replace a range of the line and put the cursor after it
+     */
+    void Replace(size_t begin, size_t end, std::string_view text);
+
+    /**
+     *@brief Ring the bell
+     */
+    void Bell() { output.push_back('\a'); }
+
+    /**
+     *@brief Show items in columns under the line, a screen at a time
+     *
+     * Only the rows shown are formatted. Space shows the next page, Enter
+     * the next row, and q or any other key stops.
+     */
+    void ShowList(std::vector<std::string> items);
+};
+
+#endif // !_LINE_EDITOR_H_
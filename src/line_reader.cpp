@@ -0,0 +1,74 @@
+#include "line_reader.h"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+LineReader::~LineReader()
+{
+    if (owned && fd != -1)
+        close(fd);
+}
+
+bool LineReader::Next(std::string_view & line)
+{
+    while (true)
+    {
+        // A complete line is already in the buffer
+        const char * newline =
+            begin == end ? nullptr
+                         : static_cast<const char *>(std::memchr(
+                               buffer.data() + begin, '\n', end - begin));
+        if (newline)
+        {
+            size_t length = newline - (buffer.data() + begin);
+            line          = std::string_view(buffer.data() + begin, length);
+            begin += length + 1;
+            return true;
+        }
+
+        // The last line may have no '\n'
+        if (end_of_file)
+        {
+            if (begin == end)
+                return false;
+
+            line  = std::string_view(buffer.data() + begin, end - begin);
+            begin = end;
+            return true;
+        }
+
+        // Move the partial line to the front and make room for a block
+        if (begin != 0)
+        {
+            std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+        if (buffer.size() < end + BLOCK_SIZE)
+            buffer.resize(end + BLOCK_SIZE);
+
+        ssize_t length = read(fd, buffer.data() + end, BLOCK_SIZE);
+        if (length == -1 && errno == EINTR)
+            continue;
+
+        if (length <= 0)
+            end_of_file = true;
+        else
+            end += length;
+    }
+}
+
+void LineReader::Rewind()
+{
+    if (begin == end)
+        return;
+
+    // Only drop the read-ahead if the file position could be moved back
+    if (lseek(fd, -static_cast<off_t>(end - begin), SEEK_CUR) != -1)
+    {
+        begin = end = 0;
+        end_of_file = false;
+    }
+
+    return;
+}
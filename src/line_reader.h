@@ -0,0 +1,56 @@
+#ifndef _LINE_READER_H_
+#define _LINE_READER_H_
+
+#include <string_view>
+#include <vector>
+
+/**
+ *@brief Read the lines of a script from a file descriptor in bulk
+ *
+ * The input is read in large blocks instead of one character at a time, and
+ * the lines are handed out as views into the block.
+ */
+class LineReader
+{
+private:
+    int               fd;
+    bool              owned; /* Whether `fd` is closed with the reader */
+    std::vector<char> buffer;
+    size_t            begin       = 0; /* The first byte not handed out */
+    size_t            end         = 0; /* The end of the data read */
+    bool              end_of_file = false;
+
+    // The size of a single read
+    static constexpr size_t BLOCK_SIZE = 1 << 16;
+
+public:
+    /**
+     *@brief Construct a new Line Reader
+     *
+     * @param fd the file descriptor to read
+     * @param owned whether to close it with the reader
+     */
+    explicit LineReader(int fd, bool owned = false) : fd(fd), owned(owned) {}
+    ~LineReader();
+
+    LineReader(const LineReader &)             = delete;
+    LineReader & operator=(const LineReader &) = delete;
+
+    /**
+     *@brief Get the next line
+     *
+     * @param line the line without its '\n', valid until the next call
+     * @return false at the end of the input
+     */
+    bool Next(std::string_view & line);
+
+    /**
+     *@brief Give the input read ahead back to the file
+     *
+     * A child sharing the file descriptor then reads from where the shell
+     * stopped. It only works on seekable files.
+     */
+    void Rewind();
+};
+
+#endif // !_LINE_READER_H_
@@ -1,15 +1,52 @@
 #include "shell.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
+#include <string_view>
+#include <unistd.h>
 
-int main()
+int main(int argc, char * argv[])
 {
-    // Flush after every std::cout / std:cerr
-    std::cout << std::unitbuf;
-    std::cerr << std::unitbuf;
+    // Block-buffer the output, it is flushed before a child runs and at exit
+    std::ios::sync_with_stdio(false);
 
     Shell shell;
 
-    shell.ExecuteShell();
+    // shell -c 'commands'
+    if (argc > 1 && std::string_view(argv[1]) == "-c")
+    {
+        if (argc < 3)
+        {
+            std::cerr << "shell: -c: option requires an argument\n";
+            return 2;
+        }
+        return shell.ExecuteString(argv[2]);
+    }
+
+    // shell script.sh
+    if (argc > 1)
+    {
+        int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            std::cerr << "shell: " << argv[1] << ": " << std::strerror(errno)
+                      << '\n';
+            return 127;
+        }
+
+        int status = shell.ExecuteScript(fd);
+        close(fd);
+        return status;
+    }
+
+    // Commands piped into the shell
+    if (!isatty(STDIN_FILENO))
+        return shell.ExecuteScript(STDIN_FILENO);
+
+    // Flush after every std::cout / std:cerr while the user is typing
+    std::cout << std::unitbuf;
+    std::cerr << std::unitbuf;
 
-    return 0;
+    return shell.ExecuteShell();
 }
@@ -0,0 +1,184 @@
+#include "parallel_runner.h"
+#include "process.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+bool ParallelRunner::Take(size_t worker, size_t & job)
+{
+    {
+        Queue &         own = *queues[worker];
+        std::lock_guard lock(own.mutex);
+        if (!own.jobs.empty())
+        {
+            job = own.jobs.front();
+            own.jobs.pop_front();
+            return true;
+        }
+    }
+
+    // Steal the last job of the next worker that has one left
+    for (size_t i = 1; i < queues.size(); i++)
+    {
+        Queue &         other = *queues[(worker + i) % queues.size()];
+        std::lock_guard lock(other.mutex);
+        if (!other.jobs.empty())
+        {
+            job = other.jobs.back();
+            other.jobs.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ParallelRunner::Run(ParallelJob & job)
+{
+    int output_pipe[2] = {-1, -1};
+    int errors_pipe[2] = {-1, -1};
+    if (pipe2(output_pipe, O_CLOEXEC) == -1 ||
+        pipe2(errors_pipe, O_CLOEXEC) == -1)
+    {
+        job.errors = std::string("parallel: pipe: ") + std::strerror(errno) + '\n';
+        job.status = 1;
+        for (int fd : {output_pipe[0], output_pipe[1]})
+            if (fd != -1)
+                close(fd);
+        return;
+    }
+
+    std::vector<std::string_view> arguments(job.arguments.begin(),
+                                            job.arguments.end());
+    pid_t pid = spawnProcess(path, arguments,
+                             {{STDERR_FILENO, errors_pipe[1], false}},
+                             input_fd, output_pipe[1], {},
+                             environment->Pointers());
+    int   spawn_error = errno;
+    close(output_pipe[1]);
+    close(errors_pipe[1]);
+
+    // Read both pipes as they fill, a job may write a lot to either
+    pollfd fds[2] = {{output_pipe[0], POLLIN, 0}, {errors_pipe[0], POLLIN, 0}};
+    std::string * buffers[2] = {&job.output, &job.errors};
+    char          chunk[1 << 16];
+    while (pid != -1 && (fds[0].fd != -1 || fds[1].fd != -1))
+    {
+        if (poll(fds, 2, -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (size_t i = 0; i < 2; i++)
+        {
+            if (fds[i].fd == -1 || fds[i].revents == 0)
+                continue;
+
+            ssize_t length = read(fds[i].fd, chunk, sizeof(chunk));
+            if (length > 0)
+                buffers[i]->append(chunk, length);
+            else if (length == 0 || errno != EINTR)
+            {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+            }
+        }
+    }
+    for (const pollfd & fd : fds)
+        if (fd.fd != -1)
+            close(fd.fd);
+
+    if (pid == -1)
+    {
+        job.errors = job.arguments[0] + ": " + std::strerror(spawn_error) + '\n';
+        job.status = 127;
+        return;
+    }
+
+    // Only this child is waited for, the jobs of the shell are left alone
+    int status = 0;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+        continue;
+    job.status = WIFEXITED(status)     ? WEXITSTATUS(status)
+                 : WIFSIGNALED(status) ? 128 + WTERMSIG(status)
+                                       : 1;
+
+    return;
+}
+
+size_t ParallelRunner::RunAll(size_t worker_count, bool ordered,
+                              const Emit & emit)
+{
+    worker_count = std::max<size_t>(1, std::min(worker_count, jobs.size()));
+
+    // Deal the jobs in turns, the workers steal the rest
+    queues.clear();
+    for (size_t i = 0; i < worker_count; i++)
+        queues.push_back(std::make_unique<Queue>());
+    for (size_t i = 0; i < jobs.size(); i++)
+        queues[i % worker_count]->jobs.push_back(i);
+
+    // The jobs do not read the input of the shell
+    input_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < worker_count; w++)
+        workers.emplace_back([this, w]() {
+            size_t job = 0;
+            while (Take(w, job))
+            {
+                Run(jobs[job]);
+                {
+                    std::lock_guard lock(finished_mutex);
+                    jobs[job].done = true;
+                    finished.push_back(job);
+                }
+                finished_changed.notify_one();
+            }
+        });
+
+    // Print on this thread only, as the jobs finish
+    size_t failed = 0, emitted = 0, next = 0;
+    while (emitted < jobs.size())
+    {
+        std::unique_lock lock(finished_mutex);
+        finished_changed.wait(lock, [&]() {
+            return ordered ? jobs[next].done : !finished.empty();
+        });
+
+        std::vector<size_t> ready;
+        if (ordered)
+            for (; next < jobs.size() && jobs[next].done; next++)
+                ready.push_back(next);
+        else
+            ready.assign(finished.begin(), finished.end());
+        finished.clear();
+        lock.unlock();
+
+        for (size_t job : ready)
+        {
+            failed += jobs[job].status != 0;
+            emit(jobs[job]);
+            emitted++;
+
+            // Only the outputs not printed yet are kept
+            std::string().swap(jobs[job].output);
+            std::string().swap(jobs[job].errors);
+        }
+    }
+
+    for (std::thread & worker : workers)
+        worker.join();
+    if (input_fd != -1)
+        close(input_fd);
+    input_fd = -1;
+
+    return failed;
+}
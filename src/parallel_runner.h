@@ -0,0 +1,105 @@
+#ifndef _PARALLEL_RUNNER_H_
+#define _PARALLEL_RUNNER_H_
+
+#include "variables.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ *@brief One run of a program by `ParallelRunner`
+ */
+struct ParallelJob
+{
+    std::vector<std::string> arguments; /* The argv, `arguments[0]` first */
+    std::string              output;    /* Its stdout */
+    std::string              errors;    /* Its stderr */
+    int                      status = 0; /* The exit status, or 128 + signal */
+    bool                     done   = false;
+};
+
+/**
+ *@brief Run many jobs of a program on a bounded number of workers
+ *
+ * Each worker has its own queue of jobs. It takes its next job from the front
+ * of its queue, and once the queue is empty it steals from the back of
+ * another one, so a worker that got the short jobs helps the others instead
+ * of idling. A worker spawns its job, reads its stdout and stderr into the
+ * buffers of the job, and waits for it, so the outputs of two jobs never mix.
+ * The finished jobs are handed to the calling thread, which alone prints.
+ */
+class ParallelRunner
+{
+public:
+    /**
+     *@brief Called on the calling thread with each finished job, in the
+     * order they finish or in the order of the jobs
+     */
+    using Emit = std::function<void(ParallelJob & job)>;
+
+private:
+    struct Queue
+    {
+        std::mutex         mutex;
+        std::deque<size_t> jobs; /* The indexes of the jobs */
+    };
+
+    std::string                         path; /* The program, resolved */
+    std::shared_ptr<const Environment>  environment;
+    std::vector<ParallelJob> &          jobs;
+    std::vector<std::unique_ptr<Queue>> queues;
+    int                                 input_fd = -1; /* The stdin of jobs */
+
+    // The finished jobs not yet emitted, under `finished_mutex`
+    std::mutex              finished_mutex;
+    std::condition_variable finished_changed;
+    std::deque<size_t>      finished;
+
+    /**
+     *@brief Take the next job of a worker, stealing one if its queue is empty
+     *
+     * @return bool false once every queue is empty
+     */
+    bool Take(size_t worker, size_t & job);
+
+    /**
+     *@brief Run a job to its end
+     */
+    void Run(ParallelJob & job);
+
+public:
+    /**
+     *@param path the resolved path of the program, the same for every job
+     *@param environment the environment of every job
+     *@param jobs the jobs, which get their output and status
+     */
+    ParallelRunner(std::string path,
+                   std::shared_ptr<const Environment> environment,
+                   std::vector<ParallelJob> &         jobs)
+        : path(std::move(path)), environment(std::move(environment)),
+          jobs(jobs)
+    {
+    }
+    ~ParallelRunner() {}
+
+    ParallelRunner(const ParallelRunner &)             = delete;
+    ParallelRunner & operator=(const ParallelRunner &) = delete;
+
+    /**
+     *@brief Run all the jobs and wait for them
+     *
+     * @param worker_count the most jobs running at once
+     * @param ordered whether to emit the jobs in their order, rather than as
+     * they finish
+     * @param emit called with each finished job
+     * @return size_t the number of jobs that failed
+     */
+    size_t RunAll(size_t worker_count, bool ordered, const Emit & emit);
+};
+
+#endif // !_PARALLEL_RUNNER_H_
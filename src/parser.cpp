@@ -0,0 +1,726 @@
+#include "parser.h"
+#include "glob_expander.h"
+#include "variables.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <optional>
+
+namespace
+{
+/**
+ *@brief Check whether the character ends an unquoted word
+ */
+bool isWordBreak(char ch)
+{
+    static const std::string_view OPERATOR_CHARACTERS = "|&;<>";
+    return std::isspace(static_cast<unsigned char>(ch)) ||
+           OPERATOR_CHARACTERS.find(ch) != std::string_view::npos;
+}
+
+/**
+ *@brief Check whether the character makes a word a pattern
+ */
+bool isWildcard(char ch)
+{
+    return ch == '*' || ch == '?' || ch == '[';
+}
+
+// The size of the chunks the expanded words are copied into
+constexpr size_t WORD_CHUNK = 4096;
+
+// The characters copied as they are in an unquoted word: neither a break,
+// a quote, a `$` nor the `=` of an assignment
+constexpr std::array<bool, 256> PLAIN_CHARACTERS = [] {
+    std::array<bool, 256> plain = {};
+    for (int ch = 0; ch < 256; ch++)
+        plain[ch] = std::string_view(" \t\n\v\f\r|&;<>'\"\\$=`").find(
+                        static_cast<char>(ch)) == std::string_view::npos;
+    return plain;
+}();
+
+bool isNameCharacter(char ch)
+{
+    return std::isalnum(static_cast<unsigned char>(ch)) || ch == '_';
+}
+
+/**
+ *@brief Get the length of the parameter name at the start of a text
+ *
+ * @return size_t 1 for a special parameter, 0 if there is no name
+ */
+size_t nameLength(std::string_view text)
+{
+    if (text.empty())
+        return 0;
+    if (std::string_view("?$!0").find(text[0]) != std::string_view::npos)
+        return 1;
+    if (std::isdigit(static_cast<unsigned char>(text[0])))
+        return 0;
+
+    size_t length = 0;
+    while (length < text.size() && isNameCharacter(text[length]))
+        length++;
+
+    return length;
+}
+
+/**
+ *@brief Find the `}` closing a `${`, skipping the ones nested in it
+ *
+ * @param line the line
+ * @param position the offset after the `${`
+ * @return size_t the offset of the `}`, or npos if it is not closed
+ */
+size_t findCloseBrace(std::string_view line, size_t position)
+{
+    for (size_t depth = 1; position < line.size(); position++)
+    {
+        if (line[position] == '$' && position + 1 < line.size() &&
+            line[position + 1] == '{')
+        {
+            depth++;
+            position++;
+        }
+        else if (line[position] == '}' && --depth == 0)
+            return position;
+    }
+
+    return std::string_view::npos;
+}
+
+/**
+ *@brief Find the backquote closing a backquoted text
+ *
+ * @param line the line
+ * @param position the offset after the open backquote
+ * @return size_t the offset of the backquote, or npos if it is not closed
+ */
+size_t findCloseBackquote(std::string_view line, size_t position)
+{
+    for (; position < line.size(); position++)
+    {
+        if (line[position] == '\\')
+            position++;
+        else if (line[position] == '`')
+            return position;
+    }
+
+    return std::string_view::npos;
+}
+
+/**
+ *@brief Find the `)` closing a `$(`, skipping the quoted ones and the ones
+ * of the nested parentheses
+ *
+ * @param line the line
+ * @param position the offset after the `$(`
+ * @return size_t the offset of the `)`, or npos if it is not closed
+ */
+size_t findCloseParenthesis(std::string_view line, size_t position)
+{
+    for (size_t depth = 1; position < line.size(); position++)
+    {
+        char ch = line[position];
+        if (ch == '\\')
+            position++;
+        else if (ch == '\'')
+            position = line.find('\'', position + 1);
+        else if (ch == '`')
+            position = findCloseBackquote(line, position + 1);
+        else if (ch == '"')
+        {
+            // A `$(` between the double quotes has its own quotes
+            for (position++; position < line.size() && line[position] != '"';
+                 position++)
+            {
+                if (line[position] == '\\')
+                    position++;
+                else if (line.substr(position).starts_with("$("))
+                {
+                    position = findCloseParenthesis(line, position + 2);
+                    if (position == std::string_view::npos)
+                        break;
+                }
+            }
+        }
+        else if (ch == '(')
+            depth++;
+        else if (ch == ')' && --depth == 0)
+            return position;
+
+        if (position >= line.size())
+            break;
+    }
+
+    return std::string_view::npos;
+}
+
+/**
+ *@brief Check whether the character separates the words of a substitution
+ */
+bool isBlank(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\n';
+}
+} // namespace
+
+Lexer::Lexer(std::string_view line, std::string & storage,
+             const VariableStore * variables,
+             const CommandSubstitution * substitute)
+    : line(line), storage(storage), variables(variables),
+      substitute(substitute)
+{
+}
+
+void Lexer::Append(Token & token, std::string_view text, bool quoted)
+{
+    if (variables)
+    {
+        for (char ch : text)
+            Append(token, ch, quoted);
+        return;
+    }
+
+    storage.append(text);
+    if (!quoted && std::any_of(text.begin(), text.end(), isWildcard))
+        token.glob = true;
+
+    return;
+}
+
+bool Lexer::ReadParameter(Token & token, bool quoted)
+{
+    size_t           begin = position - 1; /* The `$` */
+    size_t           end   = position;     /* After the parameter */
+    std::string_view name;
+    std::string_view word; /* The default of `${NAME:-word}` */
+    char             op = 0; /* `:` for `:-`, `-` for `-`, 0 for none */
+
+    if (position < line.size() && line[position] == '(')
+        return ReadSubstitution(token, quoted);
+
+    if (position < line.size() && line[position] == '{')
+    {
+        size_t close = findCloseBrace(line, position + 1);
+        if (close == std::string_view::npos)
+            return false;
+
+        std::string_view inside =
+            line.substr(position + 1, close - position - 1);
+        name                  = inside.substr(0, nameLength(inside));
+        std::string_view rest = inside.substr(name.size());
+
+        if (rest.starts_with(":-"))
+            op = ':';
+        else if (rest.starts_with('-'))
+            op = '-';
+        else if (!rest.empty())
+            return false;
+
+        word = rest.substr(op == ':' ? 2 : op == '-' ? 1 : 0);
+        end  = close + 1;
+    }
+    else
+    {
+        name = line.substr(position, nameLength(line.substr(position)));
+        end  = position + name.size();
+    }
+
+    if (name.empty())
+        return false;
+
+    token.expanded = true;
+
+    // Keep the parameter for the parse at run time
+    if (!variables)
+    {
+        storage.append(line.substr(begin, end - begin));
+        position = end;
+        return true;
+    }
+
+    std::optional<std::string_view> value = variables->Get(name);
+    if (!op || (value && !(op == ':' && value->empty())))
+    {
+        Append(token, value.value_or(""), quoted);
+        position = end;
+        return true;
+    }
+
+    // The default is a word of its own, with quotes and parameters in it
+    position        = word.data() - line.data();
+    size_t word_end = position + word.size();
+    while (position < word_end)
+    {
+        char ch = line[position++];
+        if (ch == '\'')
+        {
+            size_t close = std::min(line.find('\'', position), word_end);
+            Append(token, line.substr(position, close - position), true);
+            position = close + 1;
+        }
+        else if (ch == '\\' && position < word_end)
+            Append(token, line[position++], true);
+        else if (ch != '"' && (ch != '$' || !ReadParameter(token, quoted)))
+            Append(token, ch, quoted);
+    }
+    position = end;
+
+    return true;
+}
+
+bool Lexer::ReadSubstitution(Token & token, bool quoted)
+{
+    size_t           begin = position - 1; /* The `$` or the backquote */
+    size_t           end   = 0;            /* After the close */
+    std::string_view commands;
+    std::string      unescaped; /* The commands of a backquoted text */
+
+    if (line[begin] == '`')
+    {
+        size_t close = findCloseBackquote(line, position);
+        if (close == std::string_view::npos)
+            return false;
+        commands = line.substr(position, close - position);
+        end      = close + 1;
+    }
+    else
+    {
+        size_t close = findCloseParenthesis(line, position + 1);
+        if (close == std::string_view::npos)
+            return false;
+        commands = line.substr(position + 1, close - position - 1);
+        end      = close + 1;
+    }
+
+    token.expanded = true;
+    position       = end;
+
+    // Keep the substitution for the parse at run time
+    if (!variables)
+    {
+        storage.append(line.substr(begin, end - begin));
+        return true;
+    }
+
+    // Between backquotes, a backslash only escapes `\`, `` ` `` and `$`
+    if (line[begin] == '`')
+    {
+        for (size_t i = 0; i < commands.size(); i++)
+        {
+            if (commands[i] == '\\' && i + 1 < commands.size() &&
+                std::string_view("\\`$").find(commands[i + 1]) !=
+                    std::string_view::npos)
+                i++;
+            unescaped.push_back(commands[i]);
+        }
+        commands = unescaped;
+    }
+
+    std::string      result = substitute ? (*substitute)(commands) : "";
+    std::string_view output = result;
+    while (output.ends_with('\n'))
+        output.remove_suffix(1);
+
+    // Out of double quotes, the blanks split it into words, but not the
+    // value of an assignment
+    if (quoted || token.assignment)
+    {
+        Append(token, output, quoted);
+        return true;
+    }
+
+    for (char ch : output)
+    {
+        if (!isBlank(ch))
+        {
+            Append(token, ch, false);
+            continue;
+        }
+
+        std::pair<size_t, size_t> split(storage.size() - word_begin,
+                                        pattern.size());
+        if (splits.empty() || splits.back() != split)
+            splits.push_back(split);
+    }
+
+    return true;
+}
+
+void Lexer::ReadWord(Token & token)
+{
+    // Special characters for in double quote mode
+    static const std::string_view SPECIAL_CHARACTERS = "\\$\"`";
+
+    word_begin       = storage.size();
+    token.type       = TOKEN_TYPE::WORD;
+    token.quoted     = false;
+    token.expanded   = false;
+    token.glob       = false;
+    token.assignment = false;
+    pattern.clear();
+    splits.clear();
+
+    while (position < line.size() && !isWordBreak(line[position]))
+    {
+        char ch = line[position++];
+
+        if (ch == '\'') /* Copy until the close single quote sign */
+        {
+            token.quoted = true;
+            size_t end   = line.find('\'', position);
+            if (end == std::string_view::npos)
+                end = line.size();
+
+            Append(token, line.substr(position, end - position), true);
+            position = end + 1;
+        }
+        else if (ch == '\"') /* Copy until the close double quote sign */
+        {
+            token.quoted = true;
+            while (position < line.size() && line[position] != '\"')
+            {
+                // Copy up to the next special character at once
+                size_t run = position;
+                while (run < line.size() && line[run] != '\"' &&
+                       line[run] != '\\' && line[run] != '$' &&
+                       line[run] != '`')
+                    run++;
+                if (run > position)
+                {
+                    Append(token, line.substr(position, run - position), true);
+                    position = run;
+                    continue;
+                }
+
+                ch = line[position++];
+
+                // Only the special characters can be escaped
+                if (ch == '\\' && position < line.size() &&
+                    SPECIAL_CHARACTERS.find(line[position]) !=
+                        std::string_view::npos)
+                    ch = line[position++];
+                else if ((ch == '$' && ReadParameter(token, true)) ||
+                         (ch == '`' && ReadSubstitution(token, true)))
+                    continue;
+
+                Append(token, ch, true);
+            }
+            position++; /* Skip the close double quote sign */
+        }
+        else if (ch == '\\') /* Take the next character literally */
+        {
+            token.quoted = true;
+            if (position < line.size())
+                Append(token, line[position++], true);
+        }
+        else if ((ch == '$' && ReadParameter(token, false)) ||
+                 (ch == '`' && ReadSubstitution(token, false)))
+            continue;
+        else /* Common characters */
+        {
+            // `NAME=` assigns when nothing before it is quoted or expanded
+            if (ch == '=' && !token.assignment && !token.quoted &&
+                !token.expanded &&
+                VariableStore::IsName(
+                    std::string_view(storage).substr(word_begin)))
+                token.assignment = true;
+
+            // Copy the plain characters after it at once
+            size_t run = position;
+            while (run < line.size() &&
+                   PLAIN_CHARACTERS[static_cast<unsigned char>(line[run])])
+                run++;
+            if (run == position)
+                Append(token, ch, false);
+            else
+                Append(token, line.substr(position - 1, run - position + 1),
+                       false);
+            position = run;
+        }
+    }
+
+    // Never step over the end when the quote is not closed
+    if (position > line.size())
+        position = line.size();
+
+    // Terminate the word so that it can be passed to exec directly
+    storage.push_back('\0');
+    token.text = std::string_view(storage.data() + word_begin,
+                                  storage.size() - word_begin - 1);
+
+    return;
+}
+
+bool Lexer::Next(Token & token)
+{
+    // Skip the blanks before the token
+    while (position < line.size() &&
+           std::isspace(static_cast<unsigned char>(line[position])))
+        position++;
+
+    token.quoted     = false;
+    token.expanded   = false;
+    token.glob       = false;
+    token.assignment = false;
+    token.fd         = -1;
+
+    if (position >= line.size())
+    {
+        token.type = TOKEN_TYPE::END_OF_LINE;
+        token.text = "newline";
+        return false;
+    }
+
+    size_t begin = position;
+    char   ch    = line[position];
+
+    // An fd number directly followed by `<` or `>` belongs to the redirection
+    size_t digits_end = position;
+    while (digits_end < line.size() &&
+           std::isdigit(static_cast<unsigned char>(line[digits_end])))
+        digits_end++;
+
+    if (ch == '&' && position + 1 < line.size() && line[position + 1] == '>')
+    {
+        // `&>` and `&>>` redirect both stdout and stderr
+        token.type = TOKEN_TYPE::REDIRECTION;
+        position += 2;
+        if (position < line.size() && line[position] == '>')
+            position++;
+    }
+    else if (ch == '|' || ch == '&')
+    {
+        position++;
+        if (position < line.size() && line[position] == ch)
+        {
+            position++;
+            token.type = (ch == '|' ? TOKEN_TYPE::OR_IF : TOKEN_TYPE::AND_IF);
+        }
+        else
+            token.type =
+                (ch == '|' ? TOKEN_TYPE::PIPE : TOKEN_TYPE::BACKGROUND);
+    }
+    else if (ch == ';')
+    {
+        position++;
+        token.type = TOKEN_TYPE::SEQUENCE;
+    }
+    else if (digits_end < line.size() &&
+             (line[digits_end] == '>' || line[digits_end] == '<'))
+    {
+        char direction = line[digits_end];
+
+        // stdout or stdin by default
+        token.type = TOKEN_TYPE::REDIRECTION;
+        token.fd   = (digits_end == position && direction == '>' ? 1 : 0);
+        for (; position < digits_end; position++)
+            token.fd = token.fd * 10 + (line[position] - '0');
+
+        position++; /* The `>` or `<` */
+        if (position < line.size() &&
+            ((direction == '>' && line[position] == '>') ||
+             line[position] == '&'))
+            position++;
+    }
+    else
+    {
+        ReadWord(token);
+        return true;
+    }
+
+    token.text = line.substr(begin, position - begin);
+
+    return true;
+}
+
+bool parseCommandLine(std::string_view line, CommandLine & command_line,
+                      const VariableStore *       variables,
+                      const CommandSubstitution * substitute)
+{
+    // Without the variables the unquoted words never grow, so the storage
+    // is never reallocated. With them, a substitution has no bound, so the
+    // words are copied into `words` as they are read.
+    command_line.storage.clear();
+    command_line.storage.reserve(line.size() * 2 + 1);
+    if (command_line.words.size() > 1)
+        command_line.words.resize(1);
+    if (!command_line.words.empty())
+        command_line.words.front().clear();
+    command_line.matches.clear();
+    command_line.pipelines.clear();
+    command_line.error.clear();
+
+    Lexer    lexer(line, command_line.storage, variables, substitute);
+    Token    token;
+    Pipeline pipeline;
+    int      previous_connector = TOKEN_TYPE::SEQUENCE;
+    size_t   pipeline_begin     = 0; /* The offset of the pipeline text */
+
+    // Made for the first pattern, then reads each directory once
+    std::optional<GlobExpander> globs;
+
+    // Record the error with the token near it
+    auto setError = [&](const Token & near) {
+        command_line.error = "syntax error near unexpected token `" +
+                             std::string(near.text) + "'";
+        return false;
+    };
+
+    // Copy a word where the next words cannot move it, '\0' ended as well
+    auto keep = [&](std::string_view text) -> std::string_view {
+        if (!variables)
+            return text;
+
+        std::deque<std::string> & words = command_line.words;
+        if (words.empty() ||
+            words.back().capacity() - words.back().size() <= text.size())
+            words.emplace_back().reserve(
+                std::max(WORD_CHUNK, text.size() + 1));
+
+        std::string & chunk  = words.back();
+        size_t        offset = chunk.size();
+        chunk.append(text).push_back('\0');
+        return std::string_view(chunk).substr(offset, text.size());
+    };
+
+    // Add a word, or the paths it matches if it is a pattern
+    auto addWord = [&](SimpleCommand & command, std::string_view text,
+                       std::string_view pattern) {
+        if (token.glob && variables)
+        {
+            // A pattern matching nothing is left as it is
+            if (!globs)
+                globs.emplace();
+            if (globs->Expand(pattern, command_line.matches.emplace_back(),
+                              command.arguments) > 0)
+                return;
+        }
+        command.arguments.push_back(keep(text));
+    };
+
+    pipeline.commands.emplace_back();
+
+    while (true)
+    {
+        if (variables) /* The words read before are kept elsewhere */
+            command_line.storage.clear();
+        lexer.Next(token);
+        SimpleCommand & command = pipeline.commands.back();
+        bool            command_is_empty = command.arguments.empty() &&
+                                    command.redirections.empty() &&
+                                    command.assignments.empty();
+
+        switch (token.type)
+        {
+        case TOKEN_TYPE::WORD:
+            pipeline.expands |= token.expanded || token.glob;
+            if (token.assignment && command.arguments.empty())
+                command.assignments.push_back(keep(token.text));
+            else if (!lexer.Splits().empty() && !token.text.empty())
+            {
+                // Each part between the blanks of a substitution is a word
+                std::string_view pattern = lexer.Pattern();
+                size_t           text_begin = 0, pattern_begin = 0;
+                for (size_t i = 0; i <= lexer.Splits().size(); i++)
+                {
+                    auto [text_end, pattern_end] =
+                        i < lexer.Splits().size()
+                            ? lexer.Splits()[i]
+                            : std::pair(token.text.size(), pattern.size());
+                    if (text_end > text_begin)
+                        addWord(command,
+                                token.text.substr(text_begin,
+                                                  text_end - text_begin),
+                                pattern.substr(pattern_begin,
+                                               pattern_end - pattern_begin));
+                    text_begin    = text_end;
+                    pattern_begin = pattern_end;
+                }
+            }
+            else if (!token.text.empty() || token.quoted || !token.expanded)
+                /* An unquoted parameter expanding to nothing is no word */
+                addWord(command, token.text, lexer.Pattern());
+            break;
+
+        case TOKEN_TYPE::REDIRECTION:
+        {
+            std::string_view op = token.text;
+            int              fd = token.fd;
+            int              redirect_type =
+                op.ends_with('&')    ? REDIRECT_TYPE::DUPLICATE_FD
+                : op.ends_with(">>") ? REDIRECT_TYPE::APPEND_OUTPUT
+                : op.ends_with('<')  ? REDIRECT_TYPE::REDIRECT_INPUT
+                                     : REDIRECT_TYPE::REDIRECT_OUTPUT;
+
+            // The redirection must be followed by the file
+            if (!lexer.Next(token) || token.type != TOKEN_TYPE::WORD)
+                return setError(token);
+            pipeline.expands |= token.expanded;
+            token.text = keep(token.text);
+
+            // Only an fd number or `-` can be duplicated
+            if (redirect_type == REDIRECT_TYPE::DUPLICATE_FD &&
+                (token.quoted || token.text.empty() ||
+                 (token.text != "-" &&
+                  token.text.find_first_not_of("0123456789") !=
+                      std::string_view::npos)))
+                return setError(token);
+
+            // `&>file` is `>file 2>&1`
+            if (fd == -1)
+            {
+                command.redirections.push_back({1, redirect_type, token.text});
+                command.redirections.push_back(
+                    {2, REDIRECT_TYPE::DUPLICATE_FD, "1"});
+                break;
+            }
+
+            command.redirections.push_back({fd, redirect_type, token.text});
+            break;
+        }
+
+        case TOKEN_TYPE::PIPE:
+            // Once expanded, a command may be left with no word at all
+            if (command_is_empty && !variables)
+                return setError(token);
+
+            pipeline.commands.emplace_back();
+            break;
+
+        default: /* The connectors and the end of line */
+            if (command_is_empty &&
+                (!variables || pipeline.commands.size() == 1))
+            {
+                // Only an empty line or a trailing `;` or `&` is allowed
+                if (token.type != TOKEN_TYPE::END_OF_LINE ||
+                    pipeline.commands.size() > 1 ||
+                    previous_connector == TOKEN_TYPE::AND_IF ||
+                    previous_connector == TOKEN_TYPE::OR_IF)
+                    return setError(token);
+
+                return true;
+            }
+
+            pipeline.connector =
+                (token.type == TOKEN_TYPE::END_OF_LINE ? TOKEN_TYPE::SEQUENCE
+                                                       : token.type);
+            pipeline.text = line.substr(
+                pipeline_begin, (token.type == TOKEN_TYPE::END_OF_LINE
+                                     ? line.size()
+                                     : token.text.data() - line.data()) -
+                                    pipeline_begin);
+            pipeline_begin = lexer.Position();
+            previous_connector = pipeline.connector;
+            command_line.pipelines.push_back(std::move(pipeline));
+
+            if (token.type == TOKEN_TYPE::END_OF_LINE)
+                return true;
+
+            pipeline = Pipeline();
+            pipeline.commands.emplace_back();
+            break;
+        }
+    }
+}
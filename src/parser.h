@@ -0,0 +1,242 @@
+#ifndef _PARSER_H_
+#define _PARSER_H_
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class VariableStore;
+
+enum TOKEN_TYPE {
+    WORD,
+    PIPE,        /* | */
+    AND_IF,      /* && */
+    OR_IF,       /* || */
+    SEQUENCE,    /* ; or the end of the line */
+    BACKGROUND,  /* & */
+    REDIRECTION, /* < > >> <& >& &> &>> with an optional fd number */
+    END_OF_LINE
+};
+
+enum REDIRECT_TYPE {
+    REDIRECT_OUTPUT, /* n>file */
+    APPEND_OUTPUT,   /* n>>file */
+    REDIRECT_INPUT,  /* n<file */
+    DUPLICATE_FD     /* n>&m or n<&m, the target is m, or `-` to close n */
+};
+
+struct Token
+{
+    int              type = TOKEN_TYPE::END_OF_LINE;
+    std::string_view text; /* The unquoted word or the operator */
+    bool             quoted     = false; /* Any part of the word was quoted */
+    bool             expanded   = false; /* It has a parameter or `$(...)` */
+    bool             glob       = false; /* It has an unquoted `*`, `?` or `[` */
+    bool             assignment = false; /* It starts with an unquoted `NAME=` */
+    int              fd         = -1; /* The fd of a redirection, -1 for `&>` */
+};
+
+struct Redirection
+{
+    int              fd;     /* The fd to redirect */
+    int              type;   /* The REDIRECT_TYPE */
+    std::string_view target; /* The file, or the fd to duplicate */
+};
+
+struct SimpleCommand
+{
+    /**
+     * The command name followed by its arguments.
+     * Every view is followed by a '\0', so `data()` can be used as argv.
+     */
+    std::vector<std::string_view> arguments;
+    std::vector<Redirection>      redirections;
+    std::vector<std::string_view> assignments; /* The `NAME=value` before it */
+};
+
+struct Pipeline
+{
+    std::vector<SimpleCommand> commands;
+    int connector = TOKEN_TYPE::SEQUENCE; /* How it is joined to the next */
+
+    /**
+     * The text of the pipeline in the line, without its connector. A
+     * pipeline with parameters or patterns is parsed again from it when it
+     * runs, so `$?` and the patterns see what the pipelines before it did.
+     */
+    std::string_view text;
+    bool             expands = false; /* It has a parameter or a pattern */
+};
+
+/**
+ *@brief Run the commands of a `$(...)` and return what they print
+ */
+using CommandSubstitution = std::function<std::string(std::string_view)>;
+
+/**
+ *@brief The parsed form of one input line
+ *
+ * All the views in it point into `storage`, `words` or `matches`, so it can
+ * neither be copied nor moved. Parse it in place with `parseCommandLine()`
+ * and reuse it.
+ */
+struct CommandLine
+{
+    std::string             storage; /* The unquoted words, '\0' separated */
+    std::deque<std::string> words;   /* The expanded words, in chunks kept */
+    std::deque<std::string> matches; /* The paths of each pattern, the same */
+    std::vector<Pipeline>   pipelines;
+    std::string           error; /* The syntax error, if any */
+
+    CommandLine()                                = default;
+    CommandLine(const CommandLine &)             = delete;
+    CommandLine & operator=(const CommandLine &) = delete;
+};
+
+class Lexer
+{
+private:
+    std::string_view            line;
+    size_t                      position = 0;
+    std::string &               storage;
+    const VariableStore *       variables; /* nullptr to keep the parameters */
+    const CommandSubstitution * substitute; /* Runs the `$(...)` at run time */
+    std::string pattern;        /* The word with its quoted wildcards escaped */
+    size_t      word_begin = 0; /* The offset of the word in the storage */
+
+    // Where an unquoted substitution split the word: the offsets in the
+    // word and in its pattern
+    std::vector<std::pair<size_t, size_t>> splits;
+
+    /**
+     *@brief Append a character of the word to the storage
+     *
+     * At run time it goes to the pattern of the word as well, where the
+     * wildcards that were quoted are escaped.
+     *
+     * @param token the token being read
+     * @param ch the character
+     * @param quoted whether the character was quoted
+     */
+    void Append(Token & token, char ch, bool quoted)
+    {
+        bool wildcard = ch == '*' || ch == '?' || ch == '[';
+
+        storage.push_back(ch);
+        if (wildcard && !quoted)
+            token.glob = true;
+        if (variables)
+        {
+            if (quoted && (wildcard || ch == '\\'))
+                pattern.push_back('\\');
+            pattern.push_back(ch);
+        }
+    }
+
+    /**
+     *@brief Append a part of the word to the storage, like `Append()` for
+     * each of its characters
+     */
+    void Append(Token & token, std::string_view text, bool quoted);
+
+    /**
+     *@brief Read a word into the storage, handling quotes and backslashes
+     *
+     * @param token the token to fill
+     */
+    void ReadWord(Token & token);
+
+    /**
+     *@brief Expand the parameter after a `$` into the storage
+     *
+     * `$NAME`, `${NAME}`, `${NAME:-word}`, `${NAME-word}` and the special
+     * `$?`, `$$`, `$!` and `$0` are expanded, and a `$(` is read by
+     * `ReadSubstitution()`. Without variables, the text of the parameter is
+     * copied as it is.
+     *
+     * @param token the token being read, marked as expanded
+     * @param quoted whether the parameter is between double quotes
+     * @return false if no parameter follows, the `$` is then a character
+     */
+    bool ReadParameter(Token & token, bool quoted);
+
+    /**
+     *@brief Substitute the output of the commands of a `$(...)` or of a
+     * backquoted text, the `$` or the backquote being just read
+     *
+     * The trailing new lines of the output are dropped, and out of double
+     * quotes it is split into words at the blanks. Without variables, the
+     * text is copied as it is.
+     *
+     * @param token the token being read, marked as expanded
+     * @param quoted whether it is between double quotes
+     * @return false if it is not closed, the `$` or backquote is then a
+     * character
+     */
+    bool ReadSubstitution(Token & token, bool quoted);
+
+public:
+    /**
+     *@brief Construct a new Lexer
+     *
+     * @param line the line to split, which must outlive the tokens
+     * @param storage where the unquoted words are written to
+     * @param variables the variables to expand, nullptr to keep them
+     * @param substitute what runs the substitutions when expanding
+     */
+    Lexer(std::string_view line, std::string & storage,
+          const VariableStore *       variables  = nullptr,
+          const CommandSubstitution * substitute = nullptr);
+    ~Lexer() {}
+
+    /**
+     *@brief Get the offset in the line after the last token
+     */
+    size_t Position() const { return position; }
+
+    /**
+     *@brief Get the pattern of the last word, when parsing at run time
+     */
+    std::string_view Pattern() const { return pattern; }
+
+    /**
+     *@brief Get where a substitution split the last word, when parsing at
+     * run time, as offsets in the word and in its pattern
+     */
+    const std::vector<std::pair<size_t, size_t>> & Splits() const
+    {
+        return splits;
+    }
+
+    /**
+     *@brief Get the next token
+     *
+     * @param token the token to fill
+     * @return false if the end of the line is reached
+     */
+    bool Next(Token & token);
+};
+
+/**
+ *@brief Split the line into pipelines in a single pass
+ *
+ * With the variables, the parameters and the substitutions are expanded and
+ * each word with an unquoted wildcard is replaced by the paths it matches,
+ * or kept if it matches none.
+ *
+ * @param line the input line
+ * @param command_line the result, cleared before parsing
+ * @param variables the variables to expand, nullptr to keep the parameters
+ * and only mark the pipelines having some
+ * @param substitute what runs the substitutions, nullptr to expand them to
+ * nothing
+ * @return true if the line has no syntax error
+ */
+bool parseCommandLine(std::string_view line, CommandLine & command_line,
+                      const VariableStore *       variables  = nullptr,
+                      const CommandSubstitution * substitute = nullptr);
+
+#endif // !_PARSER_H_
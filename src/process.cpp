@@ -0,0 +1,489 @@
+#include "process.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <spawn.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+extern char ** environ;
+
+namespace
+{
+// The files opened for redirections go above the fds users name
+constexpr int FIRST_PRIVATE_FD = 10;
+
+// The least room left in the string a pipe is read into
+constexpr size_t PIPE_CHUNK = 4096;
+
+// Whether this process is a child of `forkProcess()`
+bool forked_child = false;
+
+// The signals the shell ignores or handles itself, a child gets them back
+constexpr int CHILD_DEFAULT_SIGNALS[] = {SIGINT,  SIGQUIT, SIGTSTP,
+                                         SIGTTIN, SIGTTOU, SIGCHLD};
+
+/**
+ *@brief Copy from one fd to another through a buffer
+ *
+ * @return bool false if reading or writing failed
+ */
+bool copyData(int input_fd, int output_fd)
+{
+    char    buffer[1 << 16];
+    ssize_t length = 0;
+
+    while ((length = read(input_fd, buffer, sizeof(buffer))) != 0)
+    {
+        if (length == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        for (ssize_t written = 0, n = 0; written < length; written += n)
+            if ((n = write(output_fd, buffer + written, length - written)) ==
+                -1)
+            {
+                if (errno != EINTR)
+                    return false;
+                n = 0;
+            }
+    }
+
+    return true;
+}
+
+/**
+ *@brief Splice everything from the input into the output
+ *
+ * @return bool false if splicing or the fallback copy failed
+ */
+bool spliceData(int input_fd, int output_fd)
+{
+    const size_t CHUNK_SIZE = 1 << 20;
+    ssize_t      length     = 0;
+
+    while ((length = splice(input_fd, nullptr, output_fd, nullptr, CHUNK_SIZE,
+                            SPLICE_F_MOVE | SPLICE_F_MORE)) != 0)
+        if (length == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            // The file system can not splice, copy it instead
+            return errno == EINVAL && copyData(input_fd, output_fd);
+        }
+
+    return true;
+}
+
+/**
+ *@brief Close the close-on-exec fds, as exec would do
+ *
+ * A forked child that never calls exec would otherwise keep the pipe ends of
+ * the other stages open. It runs right after fork, so it does not allocate.
+ */
+void closeExecDescriptors()
+{
+    int directory_fd =
+        open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory_fd == -1)
+        return;
+
+    char buffer[4096];
+    long length = 0;
+    while ((length = syscall(SYS_getdents64, directory_fd, buffer,
+                             sizeof(buffer))) > 0)
+        for (long offset = 0; offset < length;)
+        {
+            auto * entry = reinterpret_cast<dirent64 *>(buffer + offset);
+            offset += entry->d_reclen;
+
+            int fd = std::atoi(entry->d_name);
+            if (fd > STDERR_FILENO && fd != directory_fd &&
+                (fcntl(fd, F_GETFD) & FD_CLOEXEC))
+                close(fd);
+        }
+
+    close(directory_fd);
+}
+} // namespace
+
+bool openRedirections(const std::vector<Redirection> & redirections,
+                      std::vector<FdAction> &          actions)
+{
+    actions.clear();
+
+    for (const Redirection & redirection : redirections)
+    {
+        std::string_view target = redirection.target;
+
+        if (redirection.type == REDIRECT_TYPE::DUPLICATE_FD)
+        {
+            if (target == "-")
+            {
+                actions.push_back({redirection.fd, -1, false});
+                continue;
+            }
+
+            int source = 0;
+            std::from_chars(target.data(), target.data() + target.size(),
+                            source);
+
+            // The source may have been set by a previous redirection
+            auto previous = std::find_if(
+                actions.rbegin(), actions.rend(),
+                [&](const FdAction & action) { return action.fd == source; });
+            bool is_open = previous != actions.rend()
+                               ? previous->source != -1
+                               : fcntl(source, F_GETFD) != -1;
+            if (!is_open)
+            {
+                std::cerr << "shell: " << target << ": "
+                          << std::strerror(EBADF) << '\n';
+                closeRedirections(actions);
+                return false;
+            }
+
+            actions.push_back({redirection.fd, source, false});
+            continue;
+        }
+
+        int flags = O_CLOEXEC;
+        if (redirection.type == REDIRECT_TYPE::REDIRECT_INPUT)
+            flags |= O_RDONLY;
+        else
+            flags |= O_WRONLY | O_CREAT |
+                     (redirection.type == REDIRECT_TYPE::APPEND_OUTPUT
+                          ? O_APPEND
+                          : O_TRUNC);
+
+        // The target is '\0' terminated
+        int fd = open(target.data(), flags, 0644);
+        if (fd != -1 && fd < FIRST_PRIVATE_FD)
+        {
+            int moved = fcntl(fd, F_DUPFD_CLOEXEC, FIRST_PRIVATE_FD);
+            close(fd);
+            fd = moved;
+        }
+
+        if (fd == -1)
+        {
+            std::cerr << "shell: " << target << ": " << std::strerror(errno)
+                      << '\n';
+            closeRedirections(actions);
+            return false;
+        }
+
+        actions.push_back({redirection.fd, fd, true});
+    }
+
+    return true;
+}
+
+void closeRedirections(std::vector<FdAction> & actions)
+{
+    for (const FdAction & action : actions)
+        if (action.owned)
+            close(action.source);
+    actions.clear();
+
+    return;
+}
+
+bool applyRedirections(const std::vector<FdAction> & actions,
+                       std::vector<SavedFd> &        saved)
+{
+    for (const FdAction & action : actions)
+    {
+        // Keep the fd the first time it is replaced
+        if (std::none_of(saved.begin(), saved.end(), [&](const SavedFd & s) {
+                return s.fd == action.fd;
+            }))
+            saved.push_back(
+                {action.fd, fcntl(action.fd, F_DUPFD_CLOEXEC, FIRST_PRIVATE_FD)});
+
+        bool done = action.source == -1
+                        ? close(action.fd) == 0 || errno == EBADF
+                        : dup2(action.source, action.fd) != -1;
+        if (!done)
+        {
+            std::cerr << "shell: " << action.fd << ": " << std::strerror(errno)
+                      << '\n';
+            restoreRedirections(saved);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void restoreRedirections(std::vector<SavedFd> & saved)
+{
+    // In reverse, in case a copy took a replaced fd
+    for (auto iter = saved.rbegin(); iter != saved.rend(); ++iter)
+        if (iter->copy != -1)
+        {
+            dup2(iter->copy, iter->fd);
+            close(iter->copy);
+        }
+        else
+            close(iter->fd);
+    saved.clear();
+
+    return;
+}
+
+pid_t spawnProcess(std::string_view                      path,
+                   const std::vector<std::string_view> & arguments,
+                   const std::vector<FdAction> &         actions,
+                   int input_fd, int output_fd, const ProcessGroup & group,
+                   char * const * environment)
+{
+    // Build the null-terminated argv, pointing into the parsed words
+    std::vector<char *> argv;
+    argv.reserve(arguments.size() + 1);
+    for (std::string_view arg : arguments)
+        argv.push_back(const_cast<char *>(arg.data()));
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t file_actions;
+    posix_spawn_file_actions_init(&file_actions);
+
+    // A foreground job takes the terminal before it can read from it
+    if (group.terminal_fd != -1)
+        posix_spawn_file_actions_addtcsetpgrp_np(&file_actions,
+                                                 group.terminal_fd);
+
+    // Connect the pipes before the redirections, so that they can override
+    if (input_fd != -1)
+        posix_spawn_file_actions_adddup2(&file_actions, input_fd, STDIN_FILENO);
+    if (output_fd != -1)
+        posix_spawn_file_actions_adddup2(&file_actions, output_fd,
+                                         STDOUT_FILENO);
+
+    // The files are already open, the child only moves them in place
+    for (const FdAction & action : actions)
+        if (action.source == -1)
+            posix_spawn_file_actions_addclose(&file_actions, action.fd);
+        else
+            posix_spawn_file_actions_adddup2(&file_actions, action.source,
+                                             action.fd);
+
+    // Ask for vfork semantics explicitly, glibc uses them by default
+    posix_spawnattr_t attributes;
+    short             flags = POSIX_SPAWN_USEVFORK | POSIX_SPAWN_SETSIGDEF |
+                  POSIX_SPAWN_SETSIGMASK;
+    posix_spawnattr_init(&attributes);
+
+    // Undo what the shell did to its own signals
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attributes, &signals);
+    for (int signal : CHILD_DEFAULT_SIGNALS)
+        sigaddset(&signals, signal);
+    posix_spawnattr_setsigdefault(&attributes, &signals);
+
+    if (group.id != -1)
+    {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attributes, group.id);
+    }
+    posix_spawnattr_setflags(&attributes, flags);
+
+    pid_t pid   = -1;
+    int   error = posix_spawn(&pid, path.data(), &file_actions, &attributes,
+                              argv.data(),
+                              environment ? environment : environ);
+
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&file_actions);
+
+    if (error != 0)
+    {
+        errno = error;
+        return -1;
+    }
+
+    return pid;
+}
+
+pid_t forkProcess(int input_fd, int output_fd, const std::function<int()> & body,
+                  const ProcessGroup & group)
+{
+    // Do not let the child inherit the pending output
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        std::cerr << "shell: fork: " << std::strerror(errno) << '\n';
+        return -1;
+    }
+
+    // Both set the group, so it is set whichever runs first
+    if (pid != 0)
+    {
+        if (group.id != -1)
+            setpgid(pid, group.id == 0 ? pid : group.id);
+        return pid;
+    }
+
+    if (group.id != -1)
+    {
+        setpgid(0, group.id);
+        if (group.terminal_fd != -1) /* SIGTTOU is still ignored here */
+            tcsetpgrp(group.terminal_fd, getpgrp());
+    }
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigprocmask(SIG_SETMASK, &signals, nullptr);
+    for (int signal : CHILD_DEFAULT_SIGNALS)
+        std::signal(signal, SIG_DFL);
+
+    // The pipes are close-on-exec, but the child never calls exec
+    if (input_fd != -1)
+    {
+        dup2(input_fd, STDIN_FILENO);
+        close(input_fd);
+    }
+    if (output_fd != -1)
+    {
+        dup2(output_fd, STDOUT_FILENO);
+        close(output_fd);
+    }
+    closeExecDescriptors();
+
+    forked_child = true;
+    int status   = body();
+
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+    _exit(status);
+}
+
+void exitProcess(int status)
+{
+    if (!forked_child)
+        std::exit(status);
+
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+    _exit(status);
+}
+
+bool readPipe(int fd, std::string & output)
+{
+    size_t  size   = output.size();
+    ssize_t length = 0;
+
+    for (;;)
+    {
+        // Read into the free capacity, doubled whenever it is used up
+        if (output.capacity() - size < PIPE_CHUNK)
+            output.reserve(std::max(output.capacity() * 2, size + PIPE_CHUNK));
+        output.resize_and_overwrite(output.capacity(),
+                                    [&](char * data, size_t capacity) {
+                                        length = read(fd, data + size,
+                                                      capacity - size);
+                                        return size + std::max<ssize_t>(
+                                                          length, 0);
+                                    });
+        if (length > 0)
+            size += length;
+        else if (length == 0 || errno != EINTR)
+            break;
+    }
+
+    return length == 0;
+}
+
+int spliceFiles(std::span<const std::string_view> files, int output_fd)
+{
+    int status = 0;
+
+    for (std::string_view file : files)
+    {
+        int fd = open(file.data(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1 || !spliceData(fd, output_fd))
+        {
+            std::cerr << "cat: " << file << ": " << std::strerror(errno)
+                      << '\n';
+            status = 1;
+        }
+
+        if (fd != -1)
+            close(fd);
+    }
+
+    return status;
+}
+
+int teePipe(int input_fd, int output_fd, std::string_view file)
+{
+    int fd = open(file.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        std::cerr << "tee: " << file << ": " << std::strerror(errno) << '\n';
+        return 1;
+    }
+
+    const size_t CHUNK_SIZE = 1 << 20;
+    ssize_t      length     = 0;
+    int          status     = 0;
+
+    // Duplicate the pages into the next pipe, then move them into the file
+    while ((length = tee(input_fd, output_fd, CHUNK_SIZE, 0)) != 0)
+    {
+        if (length == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            status = 1;
+            break;
+        }
+
+        for (ssize_t moved = 0, n = 0; moved < length; moved += n)
+            if ((n = splice(input_fd, nullptr, fd, nullptr, length - moved,
+                            SPLICE_F_MOVE)) <= 0)
+            {
+                if (n == -1 && errno == EINTR)
+                {
+                    n = 0;
+                    continue;
+                }
+
+                // The file system can not splice, copy the pages instead
+                char buffer[1 << 16];
+                if (n == -1 && errno == EINVAL &&
+                    (n = read(input_fd, buffer,
+                              std::min<size_t>(sizeof(buffer),
+                                               length - moved))) > 0 &&
+                    write(fd, buffer, n) == n)
+                    continue;
+
+                std::cerr << "tee: " << file << ": " << std::strerror(errno)
+                          << '\n';
+                close(fd);
+                return 1;
+            }
+    }
+
+    close(fd);
+
+    return status;
+}
@@ -0,0 +1,158 @@
+#ifndef _PROCESS_H_
+#define _PROCESS_H_
+
+#include "parser.h"
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ *@brief One step of the redirections of a command: make `fd` a copy of
+ * `source`, or close it
+ */
+struct FdAction
+{
+    int  fd;
+    int  source; /* -1 to close `fd` */
+    bool owned;  /* `source` was opened for the redirection */
+};
+
+/**
+ *@brief An fd replaced in the shell itself, to put back afterwards
+ */
+struct SavedFd
+{
+    int fd;
+    int copy; /* -1 if `fd` was closed */
+};
+
+/**
+ *@brief The process group a child is put in
+ */
+struct ProcessGroup
+{
+    pid_t id          = -1; /* -1 for the group of the shell, 0 for a new one */
+    int   terminal_fd = -1; /* The child takes this terminal unless -1 */
+};
+
+/**
+ *@brief Open the files of the redirections, in order
+ *
+ * The shell opens them itself, so a file that cannot be opened is reported
+ * the same way for builtins and programs, and a child only has to `dup2()`.
+ * The files are close-on-exec and kept above the fds a user usually names.
+ *
+ * @param redirections the redirections of a command
+ * @param actions the steps to apply, in order
+ * @return false if a redirection failed, after printing why; nothing is
+ * left open then
+ */
+bool openRedirections(const std::vector<Redirection> & redirections,
+                      std::vector<FdAction> &          actions);
+
+/**
+ *@brief Close the files opened by `openRedirections()`
+ */
+void closeRedirections(std::vector<FdAction> & actions);
+
+/**
+ *@brief Apply the redirections to the shell itself, for a builtin
+ *
+ * @param actions the steps from `openRedirections()`
+ * @param saved the copies of the fds replaced
+ * @return false if an fd could not be replaced, the others are put back
+ */
+bool applyRedirections(const std::vector<FdAction> & actions,
+                       std::vector<SavedFd> &        saved);
+
+/**
+ *@brief Put back the fds replaced by `applyRedirections()`
+ */
+void restoreRedirections(std::vector<SavedFd> & saved);
+
+/**
+ *@brief Spawn a program directly, without going through `/bin/sh`
+ *
+ * The child is created with `posix_spawn()`, which uses vfork semantics on
+ * Linux, so the address space of the shell is never copied. It neither
+ * prints nor flushes the streams of the shell, so any thread may call it.
+ *
+ * @param path the resolved path of the program, followed by a '\0'
+ * @param arguments the argv of the program, `arguments[0]` is its name, every
+ * view must be followed by a '\0'
+ * @param actions the redirections applied in the child, after the pipes
+ * @param input_fd the fd to use as stdin, -1 to inherit it
+ * @param output_fd the fd to use as stdout, -1 to inherit it
+ * @param group the process group of the child
+ * @param environment the `envp` of the program, nullptr for the environment
+ * of the shell
+ * @return pid_t the pid of the child, or -1 with errno set if it could not
+ * be spawned
+ */
+pid_t spawnProcess(std::string_view                      path,
+                   const std::vector<std::string_view> & arguments,
+                   const std::vector<FdAction> &         actions,
+                   int input_fd = -1, int output_fd = -1,
+                   const ProcessGroup & group       = {},
+                   char * const *       environment = nullptr);
+
+/**
+ *@brief Fork the shell and run a function in the child
+ *
+ * It is used for the pipeline stages that are not programs, such as
+ * builtins. The child closes its close-on-exec fds like exec would, then
+ * flushes the output and exits with the returned status.
+ *
+ * @param input_fd the fd to use as stdin, -1 to inherit it
+ * @param output_fd the fd to use as stdout, -1 to inherit it
+ * @param body the function to run in the child
+ * @param group the process group of the child
+ * @return pid_t the pid of the child, or -1 if fork failed
+ */
+pid_t forkProcess(int input_fd, int output_fd, const std::function<int()> & body,
+                  const ProcessGroup & group = {});
+
+/**
+ *@brief End the process with a status
+ *
+ * The shell runs its exit handlers, which restore the terminal. A child of
+ * `forkProcess()` only flushes its streams and calls `_exit()`, since the
+ * handlers and the buffers of libc belong to the shell.
+ */
+[[noreturn]] void exitProcess(int status);
+
+/**
+ *@brief Read a pipe until its end, straight into a string grown as needed
+ *
+ * @param fd the read end of a pipe
+ * @param output where the data is appended
+ * @return bool false if reading failed, what was read is kept
+ */
+bool readPipe(int fd, std::string & output);
+
+/**
+ *@brief Move the content of the files into the pipe with `splice()`
+ *
+ * The data never goes through user space unless the file system does not
+ * support splicing, in which case it falls back to read and write.
+ *
+ * @param files the files to read, each followed by a '\0'
+ * @param output_fd the write end of a pipe
+ * @return int 0 on success, 1 if any file could not be read
+ */
+int spliceFiles(std::span<const std::string_view> files, int output_fd);
+
+/**
+ *@brief Copy a pipe into another pipe and a file with `tee()` and `splice()`
+ *
+ * @param input_fd the read end of a pipe
+ * @param output_fd the write end of a pipe
+ * @param file the file to copy into, followed by a '\0'
+ * @return int 0 on success, 1 if the file could not be written
+ */
+int teePipe(int input_fd, int output_fd, std::string_view file);
+
+#endif // !_PROCESS_H_
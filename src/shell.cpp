@@ -1,318 +1,1317 @@
 #include "shell.h"
-#include "tools.h"
+#include "process.h"
 #include <algorithm>
-#include <fstream>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
 #include <iomanip>
+#include <optional>
 #include <sstream>
-#include <termios.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char ** environ;
 
 namespace fs = std::filesystem;
 
-Shell::Shell()
+namespace
 {
-    ConstructCommandList();
+// The characters ending an unquoted word, those of the lexer and `<`
+constexpr std::string_view WORD_BREAKS = " \t|&;<>";
 
-    // Construct the `completion_tree`
-    for (const auto & [cmd, path] : command_list) completion_tree.Insert(cmd);
-}
+// The most commands ranked for a completion
+constexpr size_t MAX_CANDIDATES = 100;
+
+// The weight of each doubling of the command score against a fuzzy match
+constexpr double RANK_WEIGHT = 4;
 
-bool Shell::CommandExist(std::string cmd)
+// The characters to escape in a completed word
+constexpr std::string_view SPECIAL_CHARACTERS = " \t\\'\"|&;<>$`*?[#(){}";
+
+struct CompletionWord
 {
-    cmd = removeQuoteSigns(cmd);
-    return command_list.find(cmd) != command_list.end();
-}
+    size_t      begin = 0; /* The offset of the word in the line */
+    std::string text;      /* The word without its quotes */
+    bool        is_command = true;
+};
 
-bool Shell::IsBuiltin(std::string cmd)
+/**
+ *@brief Find the word ending at the cursor and whether it names a command
+ *
+ * A word names a command when it is the first of the line or follows `|`,
+ * `&` or `;`.
+ */
+CompletionWord findCompletionWord(std::string_view line, size_t cursor)
 {
-    if (!CommandExist(cmd))
-        return false;
+    CompletionWord word;
+    bool           in_word = false;
+    char           quote   = 0;
 
-    return command_list[cmd] == BUILTIN_COMMAND_STRING;
-}
+    auto start = [&](size_t i) {
+        if (!in_word)
+        {
+            in_word    = true;
+            word.begin = i;
+            word.text.clear();
+        }
+    };
 
-void Shell::ExecuteShell()
-{
-    // Help to get the redirect type
-    commands::CommandBase get_redirect_type_helper;
-    while (true)
+    for (size_t i = 0; i < cursor; i++)
     {
-        std::cout << "$ ";
-        GetInput(); /* Get the user's input */
-
-        // Get the redirect information
-        std::pair<int, std::string> redirect_information =
-            get_redirect_type_helper.SetArguments(input_line);
-        std::streambuf * backup_buffer; /* Backup the stdout or stderr */
-        std::ofstream    fout;          /* To open file */
+        char ch = line[i];
 
-        if (redirect_information.first != REDIRECT_TYPE::STDOUT)
+        if (quote)
         {
-            // Backup the buffer of stdout or stderr
-            backup_buffer =
-                ((redirect_information.first == REDIRECT_TYPE::STDOUT_TO_FILE ||
-                  redirect_information.first ==
-                      REDIRECT_TYPE::APPEND_STDOUT_TO_FILE)
-                     ? std::cout.rdbuf()
-                     : std::cerr.rdbuf());
-
-            // Open the file with different mode
-            fout.open(redirect_information.second,
-                      (redirect_information.first ==
-                           REDIRECT_TYPE::APPEND_STDOUT_TO_FILE ||
-                       redirect_information.first ==
-                           REDIRECT_TYPE::APPEND_STDERR_TO_FILE)
-                          ? std::ios::app
-                          : std::ios::out);
-
-            // Let stdout or stderr use the buffer of fout
-            if (redirect_information.first == REDIRECT_TYPE::STDOUT_TO_FILE ||
-                redirect_information.first ==
-                    REDIRECT_TYPE::APPEND_STDOUT_TO_FILE)
-                std::cout.rdbuf(fout.rdbuf());
+            if (ch == quote)
+                quote = 0;
+            else if (quote == '"' && ch == '\\' && i + 1 < cursor &&
+                     std::string_view("\\$\"`").find(line[i + 1]) !=
+                         std::string_view::npos)
+                word.text.push_back(line[++i]);
             else
-                std::cerr.rdbuf(fout.rdbuf());
+                word.text.push_back(ch);
         }
-
-        // The command exists
-        if (CommandExist(cmd))
+        else if (ch == '\'' || ch == '"')
         {
-            // The command is built-in command
-            if (command_list[cmd] == BUILTIN_COMMAND_STRING)
-                builtin_commands[cmd]->Exec(std::make_shared<Shell>(*this));
-            else /* Execute the original command */
-                std::system((addQuoteSigns(cmd) + " " + input_line).c_str());
+            start(i);
+            quote = ch;
         }
-        else /* The command does not exist */
-            std::cout << cmd << ": command not found\n";
-
-        // Reset the redirect type
-        if (redirect_information.first != REDIRECT_TYPE::STDOUT)
+        else if (ch == '\\' && i + 1 < cursor)
         {
-            if (redirect_information.first == REDIRECT_TYPE::STDOUT_TO_FILE ||
-                redirect_information.first ==
-                    REDIRECT_TYPE::APPEND_STDOUT_TO_FILE)
-                std::cout.rdbuf(backup_buffer);
-            else
-                std::cerr.rdbuf(backup_buffer);
+            start(i);
+            word.text.push_back(line[++i]);
+        }
+        else if (WORD_BREAKS.find(ch) != std::string_view::npos)
+        {
+            if (in_word)
+                word.is_command = false;
+            in_word = false;
 
-            // Close the file
-            fout.close();
+            if (ch == '|' || ch == '&' || ch == ';')
+                word.is_command = true;
+            else if (ch == '<' || ch == '>')
+                word.is_command = false;
+        }
+        else
+        {
+            start(i);
+            word.text.push_back(ch);
         }
     }
+
+    // The cursor is after a break, the word is empty
+    if (!in_word)
+    {
+        word.begin = cursor;
+        word.text.clear();
+    }
+
+    return word;
 }
 
-std::string Shell::GetEnvironmentVariable(std::string env_name)
+/**
+ *@brief Match the letters of a query in order anywhere in a name
+ *
+ * Letters at the start of the name or of one of its parts, and letters
+ * following each other, score higher; letters skipped score lower.
+ *
+ * @return std::optional<int> the quality of the match, if it matches
+ */
+std::optional<int> fuzzyMatch(std::string_view query, std::string_view name)
 {
-    return std::getenv(env_name.c_str());
+    int    quality  = 0;
+    size_t position = 0;
+
+    for (char ch : query)
+    {
+        size_t found = name.find(ch, position);
+        if (found == std::string_view::npos)
+            return std::nullopt;
+
+        if (found == 0)
+            quality += 8;
+        else if (found == position && position > 0)
+            quality += 6; /* Follows the previous letter */
+        else if (std::string_view("-_.").find(name[found - 1]) !=
+                 std::string_view::npos)
+            quality += 4;
+
+        quality -= static_cast<int>(std::min<size_t>(found - position, 3));
+        position = found + 1;
+    }
+
+    // Prefer the shorter names
+    return quality - static_cast<int>((name.size() - query.size()) / 4);
 }
 
-void Shell::ConstructCommandList()
+/**
+ *@brief Escape the special characters of a word with backslashes
+ */
+std::string escapeWord(std::string_view text)
 {
-    std::vector<std::string> environment_variable_path =
-        SplitString(GetEnvironmentVariable("PATH"), ':');
+    std::string result;
+    result.reserve(text.size());
+    for (char ch : text)
+    {
+        if (SPECIAL_CHARACTERS.find(ch) != std::string_view::npos)
+            result.push_back('\\');
+        result.push_back(ch);
+    }
 
-    for (const auto & env_path : environment_variable_path)
-        if (fs::exists(env_path) && fs::is_directory(env_path))
-            for (const auto & entry : fs::directory_iterator(env_path))
-            {
-                std::string file_name = entry.path().filename().string();
-                if (file_name.find(' ') != std::string::npos)
-                {
-                    if (file_name.find('\"') != std::string::npos)
-                        file_name = '\'' + file_name + '\'';
-                    else
-                        file_name = '\"' + file_name + '\"';
-                }
-                // command_list.insert({file_name, entry.path().string()});
-                command_list.insert({entry.path().filename().string(),
-                                     fs::absolute(entry.path()).string()});
-            }
+    return result;
+}
 
-    // Construct command_list and overwrite the external command
-    for (const auto & [key, value] : builtin_commands)
-        command_list[key] = BUILTIN_COMMAND_STRING;
+/**
+ *@brief Get the text naming a job, its arguments with `|` between stages
+ */
+std::string pipelineText(std::span<const SimpleCommand> commands)
+{
+    std::string text;
+    for (const SimpleCommand & command : commands)
+    {
+        if (!text.empty())
+            text.append(" | ");
+        for (size_t i = 0; i < command.arguments.size(); i++)
+            text.append(i ? " " : "").append(command.arguments[i]);
+    }
 
-    return;
+    return text;
 }
+} // namespace
 
-std::vector<std::string> Shell::SplitString(std::string original_string,
-                                            char        sign)
+Shell::Shell() : command_table(CommandTable::DefaultIndexFile())
 {
-    std::vector<std::string> result;
-    std::istringstream       iss(original_string);
-    std::string              token;
+    // Before any thread starts, so none of them takes SIGCHLD
+    job_table.Open();
+    variables.Import(environ);
+}
 
-    while (std::getline(iss, token, sign)) result.push_back(token);
+bool Shell::CommandExist(std::string_view cmd)
+{
+    return IsBuiltin(cmd) || FindCommand(cmd);
+}
 
-    return result;
+bool Shell::IsBuiltin(std::string_view cmd) const
+{
+    return commands::findBuiltin(cmd) != nullptr;
+}
+
+const std::string * Shell::FindCommand(std::string_view cmd, bool count_hit)
+{
+    return command_table.Find(cmd, count_hit);
+}
+
+std::string_view Shell::GetPathVariable() const
+{
+    return variables.Get("PATH").value_or("");
+}
+
+void Shell::ApplyCompletionChanges(const CommandTable::Cache & changes)
+{
+    for (const auto & [cmd, entry] : changes)
+        if (!entry.path.empty())
+            completion_tree.Insert(cmd);
+        else if (!IsBuiltin(cmd)) /* A builtin still completes */
+            completion_tree.Erase(cmd);
+
+    return;
 }
 
-void Shell::SetInputMode()
+void Shell::UpdateCompletionTree()
 {
-    termios t;
-    tcgetattr(STDIN_FILENO, &t);
-    t.c_lflag &= ~(ICANON | ECHO);
-    t.c_cc[VMIN]  = 1;
-    t.c_cc[VTIME] = 0;
-    tcsetattr(STDIN_FILENO, TCSANOW, &t);
+    const CommandIndex & index   = command_table.GetIndex();
+    CommandTable::Cache  changes = command_table.TakeChanges();
+    if (completion_ready &&
+        completion_generation == command_table.GetGeneration())
+    {
+        // Only some commands were added or removed
+        ApplyCompletionChanges(changes);
+        return;
+    }
+
+    completion_tree = Trie();
+    for (const commands::Builtin & builtin : commands::BUILTINS)
+        completion_tree.Insert(builtin.name);
+    for (size_t i = 0; i < index.Size(); i++)
+        completion_tree.Insert(index.Name(i));
+    ApplyCompletionChanges(command_table.GetOverrides());
+
+    completion_ready      = true;
+    completion_generation = command_table.GetGeneration();
 
     return;
 }
 
-void Shell::ResetInputMode()
+int Shell::ExecuteShell()
+{
+    interactive = true;
+    job_table.EnableJobControl(STDIN_FILENO);
+    line_editor.SetEventHandler(job_table.SignalFd(),
+                                [this]() { job_table.Reap(); });
+
+    history.Open(History::DefaultFile());
+    command_ranking.Open(CommandRanking::DefaultFile());
+    line_editor.SetHistory(&history);
+    line_editor.SetCompleter(
+        [this](bool previous_is_tab) { HandleCompletion(previous_is_tab); });
+
+    // Complete each edit of the line ahead of the Tab
+    CompletionEngine::Compute compute =
+        [this](Completion &                        completion,
+               const CompletionEngine::Cancelled & cancelled) {
+            ComputeCompletion(completion, true, cancelled);
+        };
+    line_editor.SetChangeHandler([this]() {
+        completion_engine.Request(line_editor.Line(), line_editor.Cursor());
+    });
+
+    // A paste may hold several lines
+    for (;;)
+    {
+        job_table.Reap();
+        job_table.Report(std::cerr);
+        completion_engine.Start(compute);
+        if (!traced(TRACE_INPUT,
+                    [&]() { return line_editor.ReadLine("$ ", input_line); }))
+            break;
+
+        // The commands change what the worker reads, and a child forked
+        // without exec may only inherit a single thread, so the worker is
+        // only alive while the line is edited
+        completion_engine.Stop();
+
+        history.Add(input_line);
+        last_exit_status = ExecuteString(input_line);
+    }
+
+    completion_engine.Stop();
+
+    return last_exit_status;
+}
+
+int Shell::ExecuteScript(int fd)
+{
+    LineReader reader(fd);
+    if (fd == STDIN_FILENO) /* The children may read the rest of it */
+        stdin_script = &reader;
+
+    std::string_view line;
+    while (traced(TRACE_INPUT, [&]() { return reader.Next(line); }))
+        last_exit_status = ExecuteLine(line);
+
+    stdin_script = nullptr;
+
+    return last_exit_status;
+}
+
+int Shell::ExecuteString(std::string_view commands)
+{
+    while (!commands.empty())
+    {
+        size_t end = std::min(commands.find('\n'), commands.size());
+        last_exit_status = ExecuteLine(commands.substr(0, end));
+        commands.remove_prefix(std::min(end + 1, commands.size()));
+    }
+
+    return last_exit_status;
+}
+
+int Shell::ExecuteLine(std::string_view line)
 {
-    termios t;
-    tcgetattr(STDIN_FILENO, &t);
-    t.c_lflag |= (ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &t);
+    // Drop the lookups a change in PATH may have made stale
+    command_table.Revalidate(GetPathVariable());
+
+    // Reap the background jobs done meanwhile
+    if (!job_table.Empty())
+        job_table.Reap();
+
+    // Tokenize and parse the whole line once
+    if (!traced(TRACE_PARSE,
+                [&]() { return parseCommandLine(line, command_line); }))
+    {
+        std::cerr << "shell: " << command_line.error << '\n';
+        return 2;
+    }
+
+    int  status    = last_exit_status;
+    bool skip_next = false;
+    for (const Pipeline & pipeline : command_line.pipelines)
+    {
+        if (!skip_next)
+            status = last_exit_status = pipeline.expands
+                                            ? ExecuteExpanded(pipeline)
+                                            : ExecutePipeline(pipeline);
+
+        // Decide whether the next pipeline runs
+        skip_next = (pipeline.connector == TOKEN_TYPE::AND_IF && status != 0) ||
+                    (pipeline.connector == TOKEN_TYPE::OR_IF && status == 0);
+    }
+
+    return status;
 }
 
-std::string Shell::GetCommonPrefix(std::vector<std::string> & possible_strings)
+int Shell::ExecuteExpanded(const Pipeline & pipeline)
 {
-    // Sort the vector at first in dictionary order
-    std::sort(possible_strings.begin(), possible_strings.end());
+    // Parsed again now, the pipelines before it may change the values
+    variables.SetStatus(last_exit_status);
+    substitution_status = 0;
+    if (!traced(TRACE_PARSE, [&]() {
+            return parseCommandLine(pipeline.text, expanded_line, &variables,
+                                    &substitution);
+        }))
+    {
+        std::cerr << "shell: " << expanded_line.error << '\n';
+        return 2;
+    }
 
-    // Get the first and last elements, which are most different
-    const std::string & first = possible_strings.front();
-    const std::string & last  = possible_strings.back();
+    // Every word may have expanded to nothing, `$(false)` still fails
+    if (expanded_line.pipelines.empty())
+        return std::exchange(substitution_status, 0);
 
-    // Find the first i same character position
-    size_t i = 0;
-    while (i < first.length() && i < last.length() && first[i] == last[i]) i++;
+    Pipeline & expanded = expanded_line.pipelines.front();
+    expanded.connector  = pipeline.connector;
 
-    // Return the substr
-    return first.substr(0, i);
+    int status          = ExecutePipeline(expanded);
+    substitution_status = 0;
+
+    return status;
 }
 
-void Shell::GetInput()
+std::string Shell::Substitute(std::string_view commands)
 {
-    SetInputMode();
-    input_line.clear(); /* Clear the input line */
+    CommandLine      parsed, expanded;
+    const Pipeline * pipeline = nullptr; /* The only one, expanded */
+    std::string      output;
 
-    char ch              = 0;
-    bool previous_is_tab = false;
+    // A single pipeline is expanded here, so it is known what it runs
+    substitution_status = 0;
+    if (parseCommandLine(commands, parsed) && parsed.pipelines.size() == 1 &&
+        parsed.pipelines.front().connector != TOKEN_TYPE::BACKGROUND)
+    {
+        pipeline = &parsed.pipelines.front();
+        if (pipeline->expands)
+        {
+            if (!parseCommandLine(pipeline->text, expanded, &variables,
+                                  &substitution))
+            {
+                std::cerr << "shell: " << expanded.error << '\n';
+                substitution_status = 2;
+                return output;
+            }
+            if (expanded.pipelines.empty())
+                return output;
+            pipeline = &expanded.pipelines.front();
+        }
+    }
 
-    while (true)
+    const SimpleCommand * command =
+        pipeline && pipeline->commands.size() == 1 &&
+                !pipeline->commands.front().arguments.empty()
+            ? &pipeline->commands.front()
+            : nullptr;
+    std::string_view cmd = command ? command->arguments.front() : "";
+
+    // A builtin that only prints writes into the string, without a fork
+    commands::CommandBase * builtin = command ? commands::findBuiltin(cmd)
+                                              : nullptr;
+    if (builtin && builtin->IsReadOnly() && command->redirections.empty() &&
+        command->assignments.empty())
+    {
+        std::ostringstream         captured;
+        commands::ExecutionContext context = {
+            *this, std::span(command->arguments).subspan(1), std::cin,
+            captured, std::cerr};
+        substitution_status = traced(
+            TRACE_BUILTIN, [&]() { return builtin->Exec(context); });
+        output = std::move(captured).str();
+        return output;
+    }
+
+    // A program writes into a pipe read until its end, a missing one is
+    // reported by the subshell
+    bool                is_program = command && !builtin && cmd != "time";
+    const std::string * path       = nullptr;
+    if (is_program)
+    {
+        TraceSpan span(TRACE_LOOKUP);
+        if (command_table.PathVariable() != GetPathVariable())
+            command_table.Revalidate(GetPathVariable());
+        path = FindCommand(cmd, true);
+    }
+    if (is_program && (path || cmd.find('/') != std::string_view::npos))
     {
-        std::cin.get(ch); /* Get a character */
-        if (ch == '\n')   /* If it is the newline, then break */
+        std::vector<FdAction> actions;
+        if (!traced(TRACE_REDIRECT, [&]() {
+                return openRedirections(command->redirections, actions);
+            }))
         {
-            std::cout << '\n';
+            substitution_status = 1;
+            return output;
+        }
+
+        std::shared_ptr<const Environment> environment =
+            command->assignments.empty()
+                ? variables.GetEnvironment()
+                : variables.GetEnvironment(command->assignments);
+        substitution_status = CaptureOutput(
+            [&](int output_fd) {
+                pid_t pid = traced(TRACE_SPAWN, [&]() {
+                    return spawnProcess(path ? std::string_view(*path) : cmd,
+                                        command->arguments, actions, -1,
+                                        output_fd, {},
+                                        environment->Pointers());
+                });
+                if (pid == -1)
+                    std::cerr << cmd << ": " << std::strerror(errno) << '\n';
+                return pid;
+            },
+            output);
+        closeRedirections(actions);
+        return output;
+    }
+
+    // The rest runs in a subshell, what it changes stays in it
+    substitution_status = CaptureOutput(
+        [&](int output_fd) {
+            return traced(TRACE_SPAWN, [&]() {
+                return forkProcess(-1, output_fd, [&]() {
+                    command_ranking.Close();
+                    job_table.EnterSubshell();
+                    interactive = false;
+                    return pipeline ? ExecutePipeline(*pipeline)
+                                    : ExecuteString(commands);
+                });
+            });
+        },
+        output);
+
+    return output;
+}
+
+int Shell::CaptureOutput(const std::function<pid_t(int)> & start,
+                         std::string &                     output)
+{
+    int pipe_fds[2] = {-1, -1};
+    if (pipe2(pipe_fds, O_CLOEXEC) == -1)
+    {
+        std::cerr << "shell: pipe: " << std::strerror(errno) << '\n';
+        return 1;
+    }
+
+    // The child may read the rest of the script, and writes to the terminal
+    if (stdin_script)
+        stdin_script->Rewind();
+    LineEditor::Suspend();
+    std::cout.flush();
+    std::cerr.flush();
+
+    pid_t pid = start(pipe_fds[1]);
+    close(pipe_fds[1]);
+    readPipe(pipe_fds[0], output);
+    close(pipe_fds[0]);
+    if (pid == -1)
+        return 127;
+
+    // Only this child is waited for, the jobs of the shell are left alone
+    int status = 0;
+    traced(TRACE_WAIT, [&]() {
+        while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+            continue;
+    });
+
+    return WIFEXITED(status)     ? WEXITSTATUS(status)
+           : WIFSIGNALED(status) ? 128 + WTERMSIG(status)
+                                 : 1;
+}
+
+int Shell::ExecutePipeline(const Pipeline & pipeline)
+{
+    const std::vector<std::string_view> & first =
+        pipeline.commands.front().arguments;
+    if (!first.empty() && first.front() == "time")
+        return ExecuteTimed(pipeline);
+
+    bool background = pipeline.connector == TOKEN_TYPE::BACKGROUND;
+    if (pipeline.commands.size() == 1 && !background)
+        return ExecuteCommand(pipeline.commands.front());
+
+    size_t             stage_count = pipeline.commands.size();
+    std::vector<pid_t> pids(stage_count, 0);
+    std::vector<int>   statuses(stage_count, 0);
+    int                input_fd = -1; /* The read end of the previous pipe */
+    pid_t              group_id = 0;  /* The first child leads the group */
+
+    // Without job control, nothing stops a background job reading the input
+    if (background && !job_table.HasJobControl())
+        input_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    // Under job control each job has its own group, the foreground one
+    // takes the terminal before it runs
+    auto groupOf = [&]() -> ProcessGroup {
+        if (!job_table.HasJobControl())
+            return {};
+        return {group_id, !background && group_id == 0
+                              ? job_table.TerminalFd()
+                              : -1};
+    };
+
+    for (size_t i = 0; i < stage_count; i++)
+    {
+        const SimpleCommand &             command   = pipeline.commands[i];
+        std::span<const std::string_view> arguments = command.arguments;
+        bool                              is_last   = (i + 1 == stage_count);
+
+        // A `cat` between two stages only copies, connect them directly
+        if (i > 0 && !is_last && arguments.size() == 1 &&
+            IsPassThrough(command, "cat"))
+            continue;
+
+        int pipe_fds[2] = {-1, -1};
+        if (!is_last && pipe2(pipe_fds, O_CLOEXEC) == -1)
+        {
+            std::cerr << "shell: pipe: " << std::strerror(errno) << '\n';
+            statuses.back() = 1;
             break;
         }
-        else if (ch == 127) /* The backspace */
+
+        if (!is_last && arguments.size() > 1 && IsPassThrough(command, "cat"))
+            /* Splice the files into the pipe */
+            pids[i] = traced(TRACE_SPAWN, [&]() {
+                return forkProcess(
+                    -1, pipe_fds[1],
+                    [&]() {
+                        return spliceFiles(arguments.subspan(1),
+                                           STDOUT_FILENO);
+                    },
+                    groupOf());
+            });
+        else if (i > 0 && !is_last && arguments.size() == 2 &&
+                 IsPassThrough(command, "tee"))
+            /* Duplicate the pipe into the next one and the file */
+            pids[i] = traced(TRACE_SPAWN, [&]() {
+                return forkProcess(
+                    input_fd, pipe_fds[1],
+                    [&]() {
+                        return teePipe(STDIN_FILENO, STDOUT_FILENO,
+                                       arguments[1]);
+                    },
+                    groupOf());
+            });
+        else
+            pids[i] = LaunchCommand(command, input_fd, pipe_fds[1],
+                                    statuses[i], groupOf(), background);
+
+        if (pids[i] == -1)
+            statuses[i] = 1;
+        else if (pids[i] > 0 && group_id == 0)
+            group_id = pids[i];
+
+        // Only the children keep the ends they use
+        if (input_fd != -1)
+            close(input_fd);
+        if (pipe_fds[1] != -1)
+            close(pipe_fds[1]);
+        input_fd = pipe_fds[0];
+    }
+
+    if (input_fd != -1)
+        close(input_fd);
+
+    if (!background)
+        return WaitForeground(pipeline.commands, group_id, pids, statuses);
+
+    std::vector<pid_t> started;
+    for (pid_t pid : pids)
+        if (pid > 0)
+            started.push_back(pid);
+    if (started.empty())
+        return statuses.back();
+
+    Job & job = job_table.Add(
+        pipelineText(pipeline.commands),
+        job_table.HasJobControl() ? group_id : -1, started, true);
+    variables.SetLastBackground(started.back());
+    if (interactive)
+        std::cerr << '[' << job.id << "] " << started.back() << '\n';
+
+    return 0;
+}
+
+int Shell::WaitForeground(std::span<const SimpleCommand> commands,
+                          pid_t group, const std::vector<pid_t> & pids,
+                          std::vector<int> & statuses)
+{
+    std::vector<pid_t> started;
+    for (pid_t pid : pids)
+        if (pid > 0)
+            started.push_back(pid);
+
+    Job * job = nullptr;
+    if (!started.empty())
+    {
+        job = &job_table.Add("", job_table.HasJobControl() ? group : -1,
+                             started, false);
+        traced(TRACE_WAIT, [&]() { job_table.Foreground(*job, false); });
+
+        for (size_t i = 0, p = 0; i < pids.size(); i++)
+            if (pids[i] > 0)
+                statuses[i] = job->processes[p++].status;
+    }
+
+    if (timing)
+        RecordStages(commands, pids, statuses, job);
+
+    if (job)
+    {
+        // Only a job that stops needs its name
+        if (job->State() == PROCESS_STATE::STOPPED)
+            job->command = pipelineText(commands);
+        FinishForeground(*job);
+    }
+
+    // The status follows the last stage, or the last failed one in pipefail
+    int status = statuses.back();
+    if (options["pipefail"])
+        for (int stage_status : statuses)
+            if (stage_status != 0)
+                status = stage_status;
+
+    return status;
+}
+
+int Shell::ExecuteTimed(const Pipeline & pipeline)
+{
+    Pipeline                        timed     = pipeline;
+    std::vector<std::string_view> & arguments = timed.commands.front().arguments;
+    int                             format    = TIME_FORMAT::TIME_TEXT;
+
+    size_t skip = 1; /* `time` and its options */
+    for (; skip < arguments.size() && arguments[skip].starts_with('-'); skip++)
+    {
+        std::string_view option = arguments[skip];
+        std::string_view name =
+            option == "-f" && skip + 1 < arguments.size() ? arguments[++skip]
+                                                          : "";
+
+        if (option == "--")
         {
-            if (!input_line.empty())
-            {
-                // Remove the last character
-                input_line.pop_back();
+            skip++;
+            break;
+        }
+        else if (option == "-p")
+            format = TIME_FORMAT::TIME_POSIX;
+        else if (name == "text" || name == "posix" || name == "json")
+            format = name == "text"    ? TIME_FORMAT::TIME_TEXT
+                     : name == "posix" ? TIME_FORMAT::TIME_POSIX
+                                       : TIME_FORMAT::TIME_JSON;
+        else
+        {
+            std::cerr << "time: " << (name.empty() ? option : name)
+                      << (option == "-f" ? ": invalid format\n"
+                                         : ": invalid option\n");
+            return 2;
+        }
+    }
+    arguments.erase(arguments.begin(), arguments.begin() + skip);
+
+    if (timed.connector == TOKEN_TYPE::BACKGROUND)
+        return ExecutePipeline(timed);
+
+    TimeReport report;
+    report.command = pipelineText(timed.commands);
+
+    // `time time ...` times the inner pipeline again, on its own
+    TimeReport * outer_timing = std::exchange(timing, &report);
+    auto         outer_start =
+        std::exchange(timing_start, std::chrono::steady_clock::now());
+    rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+
+    report.status = ExecutePipeline(timed);
+
+    getrusage(RUSAGE_SELF, &after);
+    report.real = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - timing_start)
+                      .count();
+    timing       = outer_timing;
+    timing_start = outer_start;
 
-                // Perform backspace
-                std::cout << "\b \b";
+    // A builtin run in the shell, always the last stage, used what the
+    // shell did meanwhile
+    if (!report.stages.empty() && report.stages.back().pid == 0)
+    {
+        report.stages.back().usage = usageBetween(before, after);
+        report.stages.back().real  = report.real;
+    }
+
+    std::cout.flush();
+    report.Print(std::cerr, format);
+    std::cerr.flush();
+
+    return report.status;
+}
+
+void Shell::RecordStages(std::span<const SimpleCommand> commands,
+                         const std::vector<pid_t> &     pids,
+                         const std::vector<int> & statuses, const Job * job)
+{
+    timing->stages.clear();
+    for (size_t i = 0, p = 0; i < commands.size(); i++)
+    {
+        StageTime & stage = timing->stages.emplace_back();
+        stage.command     = pipelineText(commands.subspan(i, 1));
+        stage.pid         = pids[i];
+        stage.status      = statuses[i];
+        if (pids[i] <= 0 || !job)
+            continue;
+
+        // The children are in the job in the order of the stages
+        const Job::Process & process = job->processes[p++];
+        if (process.state != PROCESS_STATE::DONE)
+            continue;
+        stage.usage = process.usage;
+        stage.real  = std::chrono::duration<double>(process.finished -
+                                                    timing_start)
+                         .count();
+    }
+
+    return;
+}
+
+int Shell::ContinueForeground(Job & job)
+{
+    LineEditor::Suspend(); /* Give the job a cooked terminal */
+    traced(TRACE_WAIT, [&]() { job_table.Foreground(job, true); });
+
+    int status = job.Status();
+    FinishForeground(job);
+
+    return status;
+}
+
+void Shell::FinishForeground(Job & job)
+{
+    const Job::Process & last = job.processes.back();
+
+    if (job.State() == PROCESS_STATE::STOPPED)
+    {
+        if (interactive) /* After the `^Z` echoed by the terminal */
+            std::cerr << '\n';
+        return;
+    }
+
+    // Say what killed it, only a new line after the `^C` for SIGINT
+    if (interactive && last.signaled && last.status - 128 != SIGPIPE)
+        std::cerr << (last.status - 128 == SIGINT ? ""
+                                                  : strsignal(last.status - 128))
+                  << '\n';
+
+    job_table.Remove(job.id);
+
+    return;
+}
+
+int Shell::ExecuteCommand(const SimpleCommand & command)
+{
+    std::vector<int> statuses(1, 0);
+    ProcessGroup     group;
+    if (job_table.HasJobControl())
+        group = {0, job_table.TerminalFd()};
+
+    pid_t pid = LaunchCommand(command, -1, -1, statuses[0], group);
+    if (pid <= 0 && !timing)
+        return statuses[0];
+
+    return WaitForeground(std::span(&command, 1), pid, {pid}, statuses);
+}
+
+pid_t Shell::LaunchCommand(const SimpleCommand & command, int input_fd,
+                           int output_fd, int & status,
+                           const ProcessGroup & group, bool background)
+{
+    status = 0;
+
+    // A command with only redirections just opens the files, and its
+    // assignments set shell variables
+    if (command.arguments.empty())
+    {
+        std::vector<FdAction> actions;
+        bool opened = openRedirections(command.redirections, actions);
+        closeRedirections(actions);
+
+        for (std::string_view assignment : command.assignments)
+            if (opened)
+            {
+                size_t equal = assignment.find('=');
+                variables.Set(assignment.substr(0, equal),
+                              assignment.substr(equal + 1));
             }
+
+        // Its status is the one of its last substitution
+        status = opened ? substitution_status : 1;
+        return 0;
+    }
+
+    std::string_view cmd = command.arguments.front();
+
+    // The commands run at the prompt rank first in the completion
+    if (command_ranking.IsOpen() && cmd.find('/') == std::string_view::npos &&
+        CommandExist(cmd))
+        command_ranking.Record(cmd);
+
+    bool                is_builtin = false;
+    const std::string * path       = nullptr;
+    {
+        TraceSpan span(TRACE_LOOKUP);
+        is_builtin = IsBuiltin(cmd);
+
+        // PATH may have been set earlier on the line
+        if (!is_builtin && command_table.PathVariable() != GetPathVariable())
+            command_table.Revalidate(GetPathVariable());
+        if (!is_builtin)
+            path = FindCommand(cmd, true);
+    }
+
+    // Spawn the program directly, a path is used as it is
+    if (!is_builtin)
+    {
+        // The files are opened first, even for a missing command
+        std::vector<FdAction> actions;
+        if (!traced(TRACE_REDIRECT, [&]() {
+                return openRedirections(command.redirections, actions);
+            }))
+        {
+            status = 1;
+            return 0;
         }
-        else if (ch == '\t') /* The tab to complete commands */
-            HandleCompletion(previous_is_tab);
-        else /* Normal characters */
+
+        if (!path && cmd.find('/') == std::string_view::npos)
         {
-            input_line.push_back(ch); /* Add to the input line */
-            std::cout << ch;          /* Output it */
+            closeRedirections(actions);
+            std::cout << cmd << ": command not found\n";
+            status = 127;
+            return 0;
         }
 
-        previous_is_tab = (ch == '\t'); /* Update previous_is_tab */
+        // Let a program reading the script from stdin start after this line
+        if (stdin_script && input_fd == -1)
+            stdin_script->Rewind();
+        LineEditor::Suspend(); /* Give the child a cooked terminal */
+
+        // The output of the shell must come before the output of the child
+        std::cout.flush();
+        std::cerr.flush();
+
+        // The assignments before the command only go to its environment
+        std::shared_ptr<const Environment> environment =
+            command.assignments.empty()
+                ? variables.GetEnvironment()
+                : variables.GetEnvironment(command.assignments);
+
+        pid_t pid = traced(TRACE_SPAWN, [&]() {
+            return spawnProcess(path ? std::string_view(*path) : cmd,
+                                command.arguments, actions, input_fd,
+                                output_fd, group, environment->Pointers());
+        });
+        if (pid == -1)
+        {
+            std::cerr << cmd << ": " << std::strerror(errno) << '\n';
+            status = 127;
+        }
+        closeRedirections(actions);
+        return pid;
     }
 
-    ResetInputMode();
+    // The output goes to the next stage of a pipeline, or it runs in the
+    // background, run it concurrently. The last stage of a pipeline is a
+    // subshell too, so `echo | exit` or `echo | cd /` leaves the shell as
+    // it was, unless the builtin only prints.
+    commands::CommandBase * builtin = commands::findBuiltin(cmd);
+    bool in_subshell = input_fd != -1 && !builtin->IsReadOnly();
 
-    // Get the cmd
-    cmd.clear();
-    std::string::iterator cmd_begin = input_line.begin(),
-                          cmd_end   = input_line.end();
+    // A builtin reading the terminal or the script is forked like a
+    // program: the terminal is cooked and its own, so ^C and ^D reach it,
+    // and it reads the script from where the shell stopped
+    bool reads_script =
+        input_fd == -1 &&
+        builtin->ReadsInput(std::span(command.arguments).subspan(1));
+    if (reads_script)
+    {
+        if (stdin_script)
+            stdin_script->Rewind();
+        LineEditor::Suspend();
+    }
 
-    // Find the first visible character
-    for (; !std::isgraph(*cmd_begin); cmd_begin++);
+    if (output_fd != -1 || background || in_subshell || reads_script)
+        return traced(TRACE_SPAWN, [&]() {
+            return forkProcess(
+                input_fd, output_fd, [&]() { return RunBuiltin(command); },
+                group);
+        });
 
-    // If the command is in the quote signs
-    if ((*cmd_begin) == '\'' || (*cmd_begin) == '\"')
+    if (input_fd == -1)
     {
-        // Store the quote sign
-        char quote_sign = (*cmd_begin);
+        status = RunBuiltin(command);
+        return 0;
+    }
 
-        // Find until meet the same quote sign
-        for (cmd_end = cmd_begin + 1;
-             cmd_end != input_line.end() && *cmd_end != quote_sign; cmd_end++);
+    // Read from the pipe in place, then restore stdin
+    int backup_fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+    dup2(input_fd, STDIN_FILENO);
+    status = RunBuiltin(command);
+    dup2(backup_fd, STDIN_FILENO);
+    close(backup_fd);
+    std::cin.clear();
+
+    return 0;
+}
+
+int Shell::RunBuiltin(const SimpleCommand & command)
+{
+    std::vector<FdAction> actions;
+    std::vector<SavedFd>  saved;
+
+    // Point the fds of the shell at the files while the builtin runs
+    bool redirected = traced(TRACE_REDIRECT, [&]() {
+        if (!openRedirections(command.redirections, actions))
+            return false;
+        if (actions.empty())
+            return true;
+
+        std::cout.flush(); /* What is buffered goes to the old fds */
+        std::cerr.flush();
+        bool applied = applyRedirections(actions, saved);
+        closeRedirections(actions);
+        return applied;
+    });
+    if (!redirected)
+        return 1;
+
+    // The output to an fd closed with `>&-` is dropped
+    std::ostream closed(nullptr);
+    auto streamOf = [&](std::ostream & stream, int fd) -> std::ostream & {
+        return saved.empty() || fcntl(fd, F_GETFD) != -1 ? stream : closed;
+    };
+
+    // Run it in place, only handing out references
+    commands::ExecutionContext context = {
+        *this, std::span(command.arguments).subspan(1), std::cin,
+        streamOf(std::cout, STDOUT_FILENO), streamOf(std::cerr, STDERR_FILENO)};
+    int status = traced(TRACE_BUILTIN, [&]() {
+        return commands::findBuiltin(command.arguments.front())->Exec(context);
+    });
+
+    if (!saved.empty())
+    {
+        std::cout.flush();
+        std::cerr.flush();
+        restoreRedirections(saved);
 
-        // Point cmd_end to the next position
-        cmd_end++;
+        // A write to a closed fd must not silence the streams for good
+        std::cin.clear();
+        std::cout.clear();
+        std::cerr.clear();
     }
-    else
-        // Find until the first invisible character
-        for (cmd_end = cmd_begin;
-             cmd_end != input_line.end() && std::isgraph(*cmd_end); cmd_end++);
 
-    cmd = std::string(cmd_begin, cmd_end); /* Copy to cmd */
-    cmd = removeQuoteSigns(cmd);           /* Remove the quote sign */
+    return status;
+}
 
-    // Remove the command from the input_line
-    input_line.erase(input_line.begin(), cmd_end);
+bool Shell::IsPassThrough(const SimpleCommand & command, std::string_view name)
+{
+    if (command.arguments.front() != name || !command.redirections.empty() ||
+        !command.assignments.empty() || !CommandExist(name) || IsBuiltin(name))
+        return false;
 
-    return;
+    // Options may change what the program does with the data
+    for (std::string_view arg : command.arguments)
+        if (arg.starts_with('-'))
+            return false;
+
+    return true;
 }
 
-void Shell::HandleCompletion(bool previous_is_tab)
+bool Shell::SetOption(std::string_view name, bool value)
 {
-    std::string           command_part; /* The command in input line */
-    std::string::iterator begin_command_part = input_line.begin(),
-                          end_command_part   = input_line.end();
-    int original_length                      = input_line.length();
+    auto iter = options.find(name);
+    if (iter == options.end())
+        return false;
 
-    // Find the first visible character position
-    for (; !std::isgraph(*begin_command_part); begin_command_part++);
+    iter->second = value;
+    if (name == "trace")
+        Tracer::SetEnabled(value);
 
-    /**
-     * Find the first space from the beign_command_part
-     * and record it as the end of command part
-     */
-    for (end_command_part = begin_command_part;
-         end_command_part != input_line.end() && *end_command_part != ' ';
-         end_command_part++);
+    return true;
+}
 
-    // Assign the command part
-    command_part = std::string(begin_command_part, end_command_part);
+void Shell::HandleCompletion(bool previous_is_tab)
+{
+    std::string_view line   = line_editor.Line();
+    size_t           cursor = line_editor.Cursor();
 
-    // Find all possible strings
-    std::vector<std::string> possible_strings =
-        completion_tree.FindPossibleStringByPrefix(command_part);
+    // Usually computed in the background while the line was typed
+    std::shared_ptr<const Completion> completion =
+        completion_engine.Find(line, cursor);
+    if (!completion || (previous_is_tab && !completion->listed))
+    {
+        completion_engine.Cancel();
+        std::lock_guard lock(completion_engine.StateMutex());
 
-    bool only_one_match = (possible_strings.size() == 1);
+        completion = std::make_shared<Completion>(
+            Complete(line, cursor, previous_is_tab));
+    }
 
     // There is no possible strings, ring the bell and exit this function
-    if (possible_strings.empty() || !only_one_match)
+    if (!completion->found || !completion->unique)
     {
-        std::cout << '\a';
-        if (possible_strings.empty())
+        line_editor.Bell();
+        if (!completion->found)
             return;
     }
 
-    // Replace the command part
-    input_line.replace(begin_command_part, end_command_part,
-                       GetCommonPrefix(possible_strings) +
-                           (only_one_match ? " " : ""));
-
-    // Clear the output and output the result of completion
-    while (original_length--) std::cout << "\b \b";
-    std::cout << input_line;
+    // Replace the word, the editor redraws the line once
+    line_editor.Replace(completion->begin, cursor, completion->text);
 
     /**
      * If the user inputs double tabs,
-     * then output all possible commands
+     * then output all possible candidates
      */
-    if (previous_is_tab)
+    if (previous_is_tab && !completion->candidates.empty())
+        line_editor.ShowList(completion->candidates);
+
+    return;
+}
+
+Completion Shell::Complete(std::string_view line, size_t cursor,
+                          bool with_list)
+{
+    Completion completion;
+    completion.line   = line;
+    completion.cursor = cursor;
+    ComputeCompletion(completion, with_list, nullptr);
+
+    return completion;
+}
+
+void Shell::ComputeCompletion(Completion & completion, bool with_list,
+                              const CompletionEngine::Cancelled & cancelled)
+{
+    TraceSpan      span(TRACE_COMPLETION);
+    CompletionWord word =
+        findCompletionWord(completion.line, completion.cursor);
+
+    completion.listed = with_list;
+    if (word.is_command && word.text.find('/') == std::string::npos)
+        CompleteCommand(completion, word.begin, word.text, cancelled);
+    else
+        CompletePath(completion, word.begin, word.text, cancelled);
+
+    return;
+}
+
+void Shell::CompleteCommand(Completion & completion, size_t begin,
+                            std::string_view                    word,
+                            const CompletionEngine::Cancelled & cancelled)
+{
+    // The full command table is only scanned once completion needs it
+    command_table.Revalidate(GetPathVariable());
+    UpdateCompletionTree();
+
+    // Query the common prefix directly from the tree
+    Trie::PrefixMatch match = completion_tree.LongestCommonPrefix(word);
+    size_t            total = 0;
+
+    // Nothing starts with the word, look for its letters anywhere
+    if (!match.found && options.at("fuzzycomplete") && !word.empty())
+    {
+        std::vector<std::string> candidates =
+            RankCommands(word, true, total, cancelled);
+
+        completion.found  = total > 0;
+        completion.unique = total == 1;
+        completion.begin  = completion.cursor; /* Keep an ambiguous word */
+        if (completion.unique)
+        {
+            completion.begin = begin;
+            completion.text  = candidates.front() + " ";
+        }
+        if (completion.listed && total > 1)
+            completion.candidates = std::move(candidates);
+        return;
+    }
+
+    completion.found  = match.found;
+    completion.unique = match.unique;
+    if (!match.found)
+        return;
+
+    std::string_view line      = completion.line;
+    size_t           cursor    = completion.cursor;
+    bool             add_space = match.unique &&
+                     (cursor == line.size() || line[cursor] != ' ');
+    completion.begin = begin;
+    completion.text  = match.common_prefix + (add_space ? " " : "");
+
+    if (completion.listed)
+        completion.candidates = RankCommands(word, false, total, cancelled);
+
+    return;
+}
+
+std::vector<std::string>
+Shell::RankCommands(std::string_view word, bool fuzzy, size_t & total,
+                    const CompletionEngine::Cancelled & cancelled)
+{
+    struct Candidate
+    {
+        double      rank;
+        std::string name;
+    };
+
+    // The names come in order, so a tie keeps the first one
+    auto better = [](const Candidate & a, const Candidate & b) {
+        return a.rank > b.rank || (a.rank == b.rank && a.name < b.name);
+    };
+
+    std::vector<Candidate> best; /* A heap with the worst one on top */
+    total = 0;
+
+    auto offer = [&](double rank, std::string_view name) {
+        total++;
+        if (best.size() == MAX_CANDIDATES)
+        {
+            if (rank <= best.front().rank)
+                return;
+            std::pop_heap(best.begin(), best.end(), better);
+            best.pop_back();
+        }
+        best.push_back({rank, std::string(name)});
+        std::push_heap(best.begin(), best.end(), better);
+    };
+
+    // The tree is walked in order, so the sorted scores are merged along
+    auto   scores = command_ranking.Scores(std::time(nullptr));
+    size_t next   = 0;
+    auto   score  = [&](std::string_view name) {
+        while (next < scores.size() && scores[next].first < name)
+            next++;
+        return next < scores.size() && scores[next].first == name
+                   ? scores[next].second
+                   : 0.0;
+    };
+
+    if (fuzzy)
+        completion_tree.VisitByPrefix("", [&](std::string_view name) {
+            double rank = score(name);
+            if (std::optional<int> quality = fuzzyMatch(word, name))
+                offer(*quality + RANK_WEIGHT * std::log2(1 + rank), name);
+            return !cancelled || !cancelled();
+        });
+    else
+        completion_tree.VisitByPrefix(word, [&](std::string_view name) {
+            offer(score(name), name);
+            return !cancelled || !cancelled();
+        });
+
+    std::sort_heap(best.begin(), best.end(), better);
+
+    std::vector<std::string> names;
+    names.reserve(best.size() + 1);
+    for (Candidate & candidate : best)
+        names.push_back(std::move(candidate.name));
+    if (total > names.size())
+        names.push_back("(" + std::to_string(total - names.size()) +
+                        " more)");
+
+    return names;
+}
+
+void Shell::CompletePath(Completion & completion, size_t begin,
+                         std::string_view                    word,
+                         const CompletionEngine::Cancelled & cancelled)
+{
+    // `~` alone becomes the home directory
+    if (word == "~")
+    {
+        completion.found  = true;
+        completion.unique = true;
+        completion.begin  = begin;
+        completion.text   = "~/";
+        return;
+    }
+
+    size_t           slash = word.rfind('/');
+    std::string_view directory_part =
+        slash == std::string_view::npos ? "" : word.substr(0, slash + 1);
+    std::string_view base = word.substr(directory_part.size());
+
+    // The listings are cached by absolute path, the working directory changes
+    std::string     directory;
+    std::error_code error;
+    if (directory_part.starts_with("~/"))
+    {
+        directory = std::string(variables.Get("HOME").value_or("")) +
+                    std::string(directory_part.substr(1));
+    }
+    else if (directory_part.starts_with('/'))
+        directory = directory_part;
+    else
+        directory = fs::current_path(error).string() + "/" +
+                    std::string(directory_part);
+
+    const std::vector<DirectoryEntry> * entries =
+        directory_cache.List(directory, cancelled);
+    if (!entries)
+        return;
+
+    // Hidden files are only completed once their dot is typed
+    std::vector<const DirectoryEntry *> candidates;
+    for (const DirectoryEntry & entry :
+         DirectoryCache::WithPrefix(*entries, base))
+        if (!base.empty() || !entry.name.starts_with('.'))
+            candidates.push_back(&entry);
+
+    if (candidates.empty())
+        return;
+
+    // The candidates are sorted, the first and the last differ the soonest
+    std::string_view first  = candidates.front()->name;
+    std::string_view last   = candidates.back()->name;
+    size_t           common = std::mismatch(first.begin(), first.end(),
+                                            last.begin(), last.end())
+                        .first -
+                    first.begin();
+
+    completion.found  = true;
+    completion.unique = candidates.size() == 1;
+
+    std::string suffix;
+    if (completion.unique)
+        suffix = candidates.front()->is_directory ? "/" : " ";
+
+    std::string_view line   = completion.line;
+    size_t           cursor = completion.cursor;
+    if (suffix == " " && cursor < line.size() && line[cursor] == ' ')
+        suffix.clear();
+
+    completion.begin = begin;
+    completion.text  = escapeWord(std::string(directory_part) +
+                                 std::string(first.substr(0, common))) +
+                      suffix;
+
+    if (completion.listed && candidates.size() > 1)
     {
-        std::cout << '\n';
-        for (const std::string & possible_command : possible_strings)
-            std::cout << possible_command << "  ";
-        std::cout << "\n$ " << input_line;
+        completion.candidates.reserve(candidates.size());
+        for (const DirectoryEntry * entry : candidates)
+        {
+            if (completion.candidates.size() % 4096 == 0 && cancelled &&
+                cancelled())
+                return;
+            completion.candidates.push_back(
+                entry->name + (entry->is_directory ? "/" : ""));
+        }
     }
 
     return;
@@ -2,49 +2,88 @@
 #define _SHELL_H_
 
 #include "command.h"
+#include "command_ranking.h"
+#include "command_table.h"
+#include "completion_engine.h"
+#include "directory_cache.h"
+#include "history.h"
+#include "job_table.h"
+#include "line_editor.h"
+#include "line_reader.h"
+#include "parser.h"
+#include "process.h"
+#include "time_report.h"
+#include "tracer.h"
+#include "tools.h"
 #include "trie.h"
+#include "variables.h"
+#include <chrono>
 #include <cstdlib>
 #include <filesystem>
 #include <iostream>
-#include <memory>
+#include <map>
+#include <span>
 #include <string>
-#include <unordered_map>
 
 class Shell
 {
 private:
-    const std::string BUILTIN_COMMAND_STRING = "builtin";
-    std::string       input_line             = "";
-    std::string       cmd                    = "";
-
-    std::unordered_map<std::string, std::shared_ptr<commands::CommandBase>>
-        builtin_commands = {
-            {"echo", std::make_shared<commands::Echo>()},
-            {"exit", std::make_shared<commands::Exit>()},
-            {"type", std::make_shared<commands::Type>()},
-            {"pwd", std::make_shared<commands::Pwd>()},
-            {"cd", std::make_shared<commands::Cd>()},
+    std::string input_line       = "";
+    int         last_exit_status = 0;
+    bool        interactive      = false;
+    CommandLine command_line;  /* Reused to keep its buffers */
+    CommandLine expanded_line; /* The pipeline parsed with its parameters */
+    VariableStore variables;
+
+    // Runs the `$(...)` of the lines, a `$?` after one sees its status
+    CommandSubstitution substitution = [this](std::string_view commands) {
+        std::string output = Substitute(commands);
+        variables.SetStatus(substitution_status);
+        return output;
+    };
+    int substitution_status = 0; /* The status of the last one run */
+
+    // The report of the pipeline run by `time`, nullptr if none is timed
+    TimeReport *                          timing = nullptr;
+    std::chrono::steady_clock::time_point timing_start;
+
+    // The options changed by `set -o` and `set +o`
+    std::map<std::string, bool, std::less<>> options = {
+        {"fuzzycomplete", false},
+        {"pipefail", false},
+        {"trace", Tracer::Enabled()},
     };
 
-    Trie completion_tree;
+    Trie     completion_tree;
+    bool     completion_ready      = false;
+    unsigned completion_generation = 0; /* The command table it is built of */
+
+    CommandTable   command_table;
+    CommandRanking command_ranking; /* Only recorded in interactive sessions */
+    DirectoryCache directory_cache; /* The directories listed to complete */
+    CompletionEngine completion_engine; /* Completes while the user types */
+    LineReader *   stdin_script = nullptr; /* The script read from stdin */
+    LineEditor     line_editor;
+    History        history; /* Only recorded in interactive sessions */
+    JobTable       job_table;
 
     /**
-     *@brief Set the input mode
+     *@brief Rebuild the `completion_tree` if the command table changed
      */
-    void SetInputMode();
+    void UpdateCompletionTree();
 
     /**
-     *@brief Reset the input mode
+     *@brief Insert the added commands into `completion_tree` and erase the
+     * removed ones
+     *
+     * @param changes the changed commands, removed ones have an empty path
      */
-    void ResetInputMode();
+    void ApplyCompletionChanges(const CommandTable::Cache & changes);
 
     /**
-     * @brief Get the common prefix of a group of strings
-     *
-     * @param possible_strings the group of strings
-     * @return std::string the common prefix
+     *@brief Get the current PATH
      */
-    std::string GetCommonPrefix(std::vector<std::string> & possible_strings);
+    std::string_view GetPathVariable() const;
 
     /**
      * @brief Handle the completion process
@@ -52,54 +91,287 @@ private:
      */
     void HandleCompletion(bool previous_is_tab);
 
-    std::unordered_map<std::string, std::string> command_list;
+    /**
+     *@brief Compute the completion of `completion.line`
+     *
+     * It runs on the worker of `completion_engine` as well, so it only
+     * reads the line from `completion` and never touches the editor.
+     *
+     * @param completion the line and the cursor, and the result
+     * @param with_list whether to fill the candidates
+     * @param cancelled whether to give up
+     */
+    void ComputeCompletion(Completion & completion, bool with_list,
+                           const CompletionEngine::Cancelled & cancelled);
+
+    /**
+     *@brief Complete the word before the cursor as a command name
+     *
+     * @param completion the line and the cursor, and the result
+     * @param begin the offset of the word in the line
+     * @param word the word, unquoted
+     * @param cancelled whether to give up
+     */
+    void CompleteCommand(Completion & completion, size_t begin,
+                         std::string_view                    word,
+                         const CompletionEngine::Cancelled & cancelled);
+
+    /**
+     *@brief Select the best commands matching a word, best first
+     *
+     * The commands are ranked by how often and how recently they ran, and
+     * for a fuzzy match by how well they match as well. The completion tree
+     * is walked once and only the best `MAX_CANDIDATES` are kept.
+     *
+     * @param word the prefix, or the subsequence for a fuzzy match
+     * @param fuzzy whether the letters of the word may be apart in the name
+     * @param total the number of matching commands
+     * @param cancelled whether to give up
+     * @return std::vector<std::string> the best commands, with a last item
+     * counting the others if any
+     */
+    std::vector<std::string>
+    RankCommands(std::string_view word, bool fuzzy, size_t & total,
+                 const CompletionEngine::Cancelled & cancelled);
+
+    /**
+     *@brief Complete the word before the cursor as a path
+     *
+     * The directory is listed through `directory_cache`, so repeated Tabs in
+     * a large directory do not read it again while it is unchanged.
+     *
+     * @param completion the line and the cursor, and the result
+     * @param begin the offset of the word in the line
+     * @param word the word, unquoted
+     * @param cancelled whether to give up
+     */
+    void CompletePath(Completion & completion, size_t begin,
+                      std::string_view                    word,
+                      const CompletionEngine::Cancelled & cancelled);
+
+    /**
+     *@brief Execute the pipelines of the line, following `&&`, `||` and `;`
+     *
+     * @param line the input line
+     * @return int the exit status of the last pipeline
+     */
+    int ExecuteLine(std::string_view line);
+
+    /**
+     *@brief Execute a pipeline
+     *
+     * @param pipeline the parsed pipeline
+     * @return int the exit status of the pipeline
+     */
+    int ExecutePipeline(const Pipeline & pipeline);
+
+    /**
+     *@brief Expand the parameters of a pipeline, then execute it
+     *
+     * @param pipeline the pipeline parsed without expanding
+     * @return int the exit status of the pipeline
+     */
+    int ExecuteExpanded(const Pipeline & pipeline);
+
+    /**
+     *@brief Run the commands of a substitution and capture their output
+     *
+     * A builtin that only prints, like `pwd` or `echo`, runs in place and
+     * prints into a string. A program is spawned with its output in a pipe,
+     * and anything else runs in a forked subshell, so `cd` or an assignment
+     * in it leaves the shell as it was. The status goes to
+     * `substitution_status`.
+     *
+     * @param commands the text between the parentheses
+     * @return std::string the output, with its trailing new lines
+     */
+    std::string Substitute(std::string_view commands);
+
+    /**
+     *@brief Start a child writing into a pipe and read all it writes
+     *
+     * @param start starts the child with the given fd as stdout
+     * @param output where the output is appended
+     * @return int the exit status of the child, 127 if it did not start
+     */
+    int CaptureOutput(const std::function<pid_t(int)> & start,
+                      std::string &                     output);
+
+    /**
+     *@brief Run a pipeline starting with the `time` keyword and report what
+     * it used
+     *
+     * `time [-p] [-f text|posix|json] pipeline` prints to stderr once the
+     * pipeline is done. A background pipeline is not timed.
+     *
+     * @param pipeline the pipeline, `time` and its options included
+     * @return int the exit status of the pipeline
+     */
+    int ExecuteTimed(const Pipeline & pipeline);
+
+    /**
+     *@brief Record the stages of a foreground pipeline in `timing`
+     *
+     * @param job the job of the children, nullptr if none was started
+     */
+    void RecordStages(std::span<const SimpleCommand> commands,
+                      const std::vector<pid_t> &     pids,
+                      const std::vector<int> & statuses, const Job * job);
+
+    /**
+     *@brief Wait for the children of a foreground pipeline
+     *
+     * They are a job while they run, so they can be stopped and continued
+     * later.
+     *
+     * @param commands the stages, to name the job if it stops
+     * @param group the process group of the children, 0 for none
+     * @param pids the child of each stage, 0 for none
+     * @param statuses the status of each stage, updated for the children
+     * @return int the exit status of the pipeline
+     */
+    int WaitForeground(std::span<const SimpleCommand> commands, pid_t group,
+                       const std::vector<pid_t> & pids,
+                       std::vector<int> &         statuses);
+
+    /**
+     *@brief Report how a foreground job ended, then forget it unless it
+     * stopped
+     */
+    void FinishForeground(Job & job);
+
+    /**
+     *@brief Execute a simple command, either builtin or external
+     *
+     * @param command the parsed command
+     * @return int the exit status of the command
+     */
+    int ExecuteCommand(const SimpleCommand & command);
+
+    /**
+     *@brief Start a simple command with the given stdin and stdout
+     *
+     * Programs are spawned, builtins run in place when they are not a
+     * stage of a pipeline, or when they end one and only print, and are
+     * forked otherwise.
+     *
+     * @param command the parsed command
+     * @param input_fd the fd to use as stdin, -1 to keep it
+     * @param output_fd the fd to use as stdout, -1 to keep it
+     * @param status the exit status if the command finished in place
+     * @param group the process group of the child
+     * @param background whether a builtin must be forked as well
+     * @return pid_t the pid of the child, 0 if it finished in place, -1 if it
+     * failed to start
+     */
+    pid_t LaunchCommand(const SimpleCommand & command, int input_fd,
+                        int output_fd, int & status,
+                        const ProcessGroup & group      = {},
+                        bool                 background = false);
+
+    /**
+     *@brief Run a builtin in this process, applying its redirections
+     *
+     * @param command the parsed command
+     * @return int the exit status of the builtin
+     */
+    int RunBuiltin(const SimpleCommand & command);
+
+    /**
+     *@brief Check whether the command is the external program `name` used
+     * without options or redirections, so the shell can move its data itself
+     *
+     * @param command the parsed command
+     * @param name the name of the program
+     */
+    bool IsPassThrough(const SimpleCommand & command, std::string_view name);
 
 public:
     Shell();
     ~Shell() {}
 
-    const std::unordered_map<std::string, std::string> & GetCommandList() const
-    {
-        return command_list;
-    }
+    CommandTable & GetCommandTable() { return command_table; }
 
-    bool CommandExist(std::string cmd);
-    bool IsBuiltin(std::string cmd);
+    History & GetHistory() { return history; }
 
-    std::string GetInputLine() const { return input_line; }
+    JobTable & GetJobTable() { return job_table; }
+
+    VariableStore & GetVariables() { return variables; }
 
     /**
-     *@brief Run the shell
+     *@brief Continue a job in the foreground and wait for it
+     *
+     * @return int the exit status of the job, 128 + the signal if it stopped
      */
-    void ExecuteShell();
+    int ContinueForeground(Job & job);
+
+    bool CommandExist(std::string_view cmd);
+    bool IsBuiltin(std::string_view cmd) const;
 
     /**
-     *@brief Get the environment variable
+     *@brief Resolve an external command through the command table
      *
-     * @param env_name The name of the environment variable
-     * @return std::string The environment variable
+     * @param cmd the name of the command
+     * @param count_hit whether it is looked up to be executed
+     * @return const std::string * the absolute path, or nullptr if not found
      */
-    std::string GetEnvironmentVariable(std::string env_name);
+    const std::string * FindCommand(std::string_view cmd,
+                                    bool             count_hit = false);
 
     /**
-     *@brief Construct the `command_list`
+     *@brief Get the exit status of the last command
      */
-    void ConstructCommandList();
+    int GetLastExitStatus() const { return last_exit_status; }
 
     /**
-     * @brief Split string by given character
+     *@brief Get the options changed by `set`
+     */
+    const std::map<std::string, bool, std::less<>> & GetOptions() const
+    {
+        return options;
+    }
+
+    /**
+     *@brief Turn an option on or off
      *
-     * @param original_string The string to split
-     * @param sign The sign to split
-     * @return std::vector<std::string> The result of small part string
+     * @param name the name of the option
+     * @param value whether the option is on
+     * @return false if there is no such option
      */
-    std::vector<std::string> SplitString(std::string original_string,
-                                         char        sign);
+    bool SetOption(std::string_view name, bool value);
 
     /**
-     *@brief Get input with completion from the user
+     *@brief Compute what Tab does to a line, without an editor
+     *
+     * @param line the line
+     * @param cursor the offset of the cursor in the line
+     * @param with_list whether to fill the candidates, as for a double Tab
+     * @return Completion the completion
+     */
+    Completion Complete(std::string_view line, size_t cursor, bool with_list);
+
+    /**
+     *@brief Run the shell interactively
+     *
+     * @return int the exit status of the last command at the end of input
+     */
+    int ExecuteShell();
+
+    /**
+     *@brief Run the lines read from a file descriptor, without prompts
+     *
+     * @param fd the script, or stdin when it is not a terminal
+     * @return int the exit status of the last command
+     */
+    int ExecuteScript(int fd);
+
+    /**
+     *@brief Run the commands given with `-c`
+     *
+     * @param commands the commands, one or more lines
+     * @return int the exit status of the last command
      */
-    void GetInput();
+    int ExecuteString(std::string_view commands);
 };
 
 #endif // !_SHELL_H_
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include "time_report.h"
+#include <algorithm>
+#include <cstdio>
+#include <sys/time.h>
+
+namespace
+{
+double seconds(const timeval & time)
+{
+    return time.tv_sec + time.tv_usec / 1e6;
+}
+
+/**
+ *@brief Add the usage of a stage to a total, the peak RSS is the largest
+ */
+void addUsage(rusage & total, const rusage & usage)
+{
+    auto add = [](timeval & sum, const timeval & time) {
+        sum.tv_sec += time.tv_sec;
+        sum.tv_usec += time.tv_usec;
+        sum.tv_sec += sum.tv_usec / 1000000;
+        sum.tv_usec %= 1000000;
+    };
+
+    add(total.ru_utime, usage.ru_utime);
+    add(total.ru_stime, usage.ru_stime);
+    total.ru_maxrss = std::max(total.ru_maxrss, usage.ru_maxrss);
+    total.ru_minflt += usage.ru_minflt;
+    total.ru_majflt += usage.ru_majflt;
+    total.ru_nvcsw += usage.ru_nvcsw;
+    total.ru_nivcsw += usage.ru_nivcsw;
+
+    return;
+}
+
+/**
+ *@brief Format seconds like `0m1.250s`
+ */
+std::string minutes(double value)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%dm%.3fs", static_cast<int>(value / 60),
+                  value - static_cast<int>(value / 60) * 60);
+    return text;
+}
+
+std::string fixed(double value, int precision)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.*f", precision, value);
+    return text;
+}
+
+void writeJsonString(std::ostream & out, const std::string & text)
+{
+    out << '"';
+    for (char ch : text)
+        if (ch == '"' || ch == '\\')
+            out << '\\' << ch;
+        else if (static_cast<unsigned char>(ch) < 0x20)
+        {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+            out << escaped;
+        }
+        else
+            out << ch;
+    out << '"';
+
+    return;
+}
+
+/**
+ *@brief Write the fields shared by the total and the stages
+ */
+void writeJsonUsage(std::ostream & out, double real, const rusage & usage)
+{
+    out << "\"real\":" << fixed(real, 6)
+        << ",\"user\":" << fixed(seconds(usage.ru_utime), 6)
+        << ",\"sys\":" << fixed(seconds(usage.ru_stime), 6)
+        << ",\"max_rss_kib\":" << usage.ru_maxrss
+        << ",\"minor_faults\":" << usage.ru_minflt
+        << ",\"major_faults\":" << usage.ru_majflt
+        << ",\"voluntary_switches\":" << usage.ru_nvcsw
+        << ",\"involuntary_switches\":" << usage.ru_nivcsw;
+
+    return;
+}
+} // namespace
+
+rusage usageBetween(const rusage & before, const rusage & after)
+{
+    rusage usage = after;
+    timersub(&after.ru_utime, &before.ru_utime, &usage.ru_utime);
+    timersub(&after.ru_stime, &before.ru_stime, &usage.ru_stime);
+    usage.ru_minflt -= before.ru_minflt;
+    usage.ru_majflt -= before.ru_majflt;
+    usage.ru_nvcsw -= before.ru_nvcsw;
+    usage.ru_nivcsw -= before.ru_nivcsw;
+
+    return usage;
+}
+
+void TimeReport::Print(std::ostream & out, int format) const
+{
+    rusage total = {};
+    for (const StageTime & stage : stages)
+        addUsage(total, stage.usage);
+
+    switch (format)
+    {
+    case TIME_FORMAT::TIME_POSIX:
+        out << "real " << fixed(real, 2) << "\nuser "
+            << fixed(seconds(total.ru_utime), 2) << "\nsys "
+            << fixed(seconds(total.ru_stime), 2) << '\n';
+        break;
+
+    case TIME_FORMAT::TIME_JSON:
+        out << "{\"command\":";
+        writeJsonString(out, command);
+        out << ",\"status\":" << status << ',';
+        writeJsonUsage(out, real, total);
+        out << ",\"stages\":[";
+        for (size_t i = 0; i < stages.size(); i++)
+        {
+            out << (i ? ",{" : "{") << "\"command\":";
+            writeJsonString(out, stages[i].command);
+            out << ",\"pid\":" << stages[i].pid
+                << ",\"status\":" << stages[i].status << ',';
+            writeJsonUsage(out, stages[i].real, stages[i].usage);
+            out << '}';
+        }
+        out << "]}\n";
+        break;
+
+    default:
+        out << "\nreal\t" << minutes(real) << "\nuser\t"
+            << minutes(seconds(total.ru_utime)) << "\nsys\t"
+            << minutes(seconds(total.ru_stime)) << "\nrss\t"
+            << total.ru_maxrss << " KiB max, faults " << total.ru_minflt
+            << " minor " << total.ru_majflt << " major, switches "
+            << total.ru_nvcsw << " voluntary " << total.ru_nivcsw
+            << " involuntary\n";
+
+        // The stages of a pipeline one per line, with their own numbers
+        if (stages.size() > 1)
+            for (size_t i = 0; i < stages.size(); i++)
+            {
+                const StageTime & stage = stages[i];
+                out << "stage " << i + 1 << "\treal "
+                    << fixed(stage.real, 3) << "s user "
+                    << fixed(seconds(stage.usage.ru_utime), 3) << "s sys "
+                    << fixed(seconds(stage.usage.ru_stime), 3) << "s rss "
+                    << stage.usage.ru_maxrss << " KiB status "
+                    << stage.status << '\t' << stage.command << '\n';
+            }
+        break;
+    }
+
+    return;
+}
@@ -0,0 +1,54 @@
+#ifndef _TIME_REPORT_H_
+#define _TIME_REPORT_H_
+
+#include <ostream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <vector>
+
+enum TIME_FORMAT {
+    TIME_TEXT,  /* real, user and sys, then the other resources and stages */
+    TIME_POSIX, /* `time -p`, real, user and sys in seconds */
+    TIME_JSON   /* One JSON object per line, for the tools */
+};
+
+/**
+ *@brief What one stage of a timed pipeline used
+ */
+struct StageTime
+{
+    std::string command;
+    pid_t       pid    = 0; /* 0 if it ran in the shell, -1 if it failed */
+    int         status = 0;
+    double      real   = 0; /* Seconds from the start of the pipeline */
+    rusage      usage  = {};
+};
+
+/**
+ *@brief What a pipeline run by `time` used, each stage and in total
+ */
+struct TimeReport
+{
+    std::string            command;
+    int                    status = 0;
+    double                 real   = 0; /* Seconds */
+    std::vector<StageTime> stages;
+
+    /**
+     *@brief Print the report
+     *
+     * @param out the stream
+     * @param format the TIME_FORMAT
+     */
+    void Print(std::ostream & out, int format) const;
+};
+
+/**
+ *@brief Get what was used between two `getrusage()` calls
+ *
+ * The peak RSS is the one of `after`, it never goes down.
+ */
+rusage usageBetween(const rusage & before, const rusage & after);
+
+#endif // !_TIME_REPORT_H_
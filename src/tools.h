@@ -1,22 +1,25 @@
 #ifndef _TOOLS_H_
 #define _TOOLS_H_
 
+#include <cstddef>
+#include <functional>
 #include <string>
+#include <string_view>
 
 /**
- *@brief Remove the quote signs around the string
+ *@brief Transparent string hash
  *
- * @param s the string to operate
- * @return std::string the result string without quote signs
+ * Lets the unordered containers keyed by `std::string` be searched with
+ * `std::string_view` without constructing a temporary string.
  */
-std::string removeQuoteSigns(std::string s);
+struct StringHash
+{
+    using is_transparent = void;
 
-/**
- *@brief Add quote signs around the string
- *
- * @param s the string  to operate
- * @return std::string the result string with quote signs
- */
-std::string addQuoteSigns(std::string s);
+    size_t operator()(std::string_view s) const
+    {
+        return std::hash<std::string_view>{}(s);
+    }
+};
 
-#endif // !_TOOLS_H_
\ No newline at end of file
+#endif // !_TOOLS_H_
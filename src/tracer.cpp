@@ -0,0 +1,283 @@
+#include "tracer.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+// The spans kept per thread, a power of two
+constexpr size_t RING_SIZE = 4096;
+
+// Each power of two is split into this many buckets
+constexpr size_t SUB_BUCKETS = 16;
+constexpr int    SUB_BITS    = 4;
+constexpr size_t BUCKETS     = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+constexpr std::array<std::string_view, TRACE_PHASES> PHASE_NAMES = {
+    "input", "parse",   "lookup",  "redirect",
+    "spawn", "wait",    "builtin", "completion",
+};
+
+/**
+ *@brief One span in a ring
+ *
+ * `sequence` is the number of the span plus one, and 0 while it is written,
+ * so a reader copying the slot can tell it was overwritten meanwhile.
+ */
+struct Slot
+{
+    std::atomic<uint64_t> sequence = 0;
+    std::atomic<uint64_t> start    = 0;
+    std::atomic<uint64_t> end      = 0;
+    std::atomic<int>      phase    = 0;
+};
+
+struct Histogram
+{
+    std::array<std::atomic<uint64_t>, BUCKETS> counts = {};
+    std::atomic<uint64_t>                      total  = 0; /* Nanoseconds */
+    std::atomic<uint64_t>                      maximum = 0;
+};
+
+/**
+ *@brief The spans and histograms of one thread, written by it alone
+ */
+struct ThreadTrace
+{
+    pid_t                                   thread = 0;
+    std::atomic<uint64_t>                   written = 0; /* Spans ever */
+    std::array<Slot, RING_SIZE>             ring;
+    std::array<Histogram, TRACE_PHASES>     histograms;
+};
+
+std::atomic<bool> enabled = [] {
+    const char * value = getenv("SHELL_TRACE");
+    return value && *value && std::string_view(value) != "0";
+}();
+
+// Every thread that recorded, kept after it exits so its spans remain
+std::mutex                                registry_mutex;
+std::vector<std::shared_ptr<ThreadTrace>> registry;
+
+ThreadTrace & threadTrace()
+{
+    thread_local std::shared_ptr<ThreadTrace> trace = [] {
+        auto            created = std::make_shared<ThreadTrace>();
+        created->thread         = gettid();
+        std::lock_guard lock(registry_mutex);
+        registry.push_back(created);
+        return created;
+    }();
+
+    return *trace;
+}
+
+size_t bucketOf(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+        return value;
+
+    // The top bits below the leading one pick the bucket in its power of two
+    int exponent = 63 - std::countl_zero(value);
+    return (exponent - SUB_BITS + 1) * SUB_BUCKETS +
+           ((value >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+/**
+ *@brief Get the value in the middle of a bucket
+ */
+uint64_t valueOf(size_t bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+
+    int      exponent = bucket / SUB_BUCKETS + SUB_BITS - 1;
+    uint64_t lowest   = (SUB_BUCKETS + bucket % SUB_BUCKETS)
+                      << (exponent - SUB_BITS);
+    return lowest + (uint64_t(1) << (exponent - SUB_BITS)) / 2;
+}
+
+std::string formatNanoseconds(double value)
+{
+    char text[32];
+    if (value < 1e3)
+        std::snprintf(text, sizeof(text), "%.0fns", value);
+    else if (value < 1e6)
+        std::snprintf(text, sizeof(text), "%.1fus", value / 1e3);
+    else if (value < 1e9)
+        std::snprintf(text, sizeof(text), "%.1fms", value / 1e6);
+    else
+        std::snprintf(text, sizeof(text), "%.2fs", value / 1e9);
+    return text;
+}
+
+std::vector<std::shared_ptr<ThreadTrace>> registeredThreads()
+{
+    std::lock_guard lock(registry_mutex);
+    return registry;
+}
+} // namespace
+
+uint64_t Tracer::Now()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+bool Tracer::Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+void Tracer::SetEnabled(bool value)
+{
+    enabled.store(value, std::memory_order_relaxed);
+    return;
+}
+
+std::string_view Tracer::PhaseName(int phase) { return PHASE_NAMES[phase]; }
+
+void Tracer::Record(int phase, uint64_t start, uint64_t end)
+{
+    ThreadTrace & trace  = threadTrace();
+    uint64_t      number = trace.written.load(std::memory_order_relaxed);
+    Slot &        slot   = trace.ring[number % RING_SIZE];
+
+    // Mark the slot busy before its fields change
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    slot.phase.store(phase, std::memory_order_relaxed);
+    slot.sequence.store(number + 1, std::memory_order_release);
+    trace.written.store(number + 1, std::memory_order_release);
+
+    uint64_t    duration  = end - start;
+    Histogram & histogram = trace.histograms[phase];
+    histogram.counts[bucketOf(duration)].fetch_add(1,
+                                                   std::memory_order_relaxed);
+    histogram.total.fetch_add(duration, std::memory_order_relaxed);
+    if (duration > histogram.maximum.load(std::memory_order_relaxed))
+        histogram.maximum.store(duration, std::memory_order_relaxed);
+
+    return;
+}
+
+void Tracer::Reset()
+{
+    for (const auto & trace : registeredThreads())
+    {
+        trace->written.store(0, std::memory_order_relaxed);
+        for (Slot & slot : trace->ring)
+            slot.sequence.store(0, std::memory_order_relaxed);
+        for (Histogram & histogram : trace->histograms)
+        {
+            for (auto & count : histogram.counts)
+                count.store(0, std::memory_order_relaxed);
+            histogram.total.store(0, std::memory_order_relaxed);
+            histogram.maximum.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    return;
+}
+
+void Tracer::PrintStatistics(std::ostream & out)
+{
+    auto threads = registeredThreads();
+
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-11s %9s %10s %10s %10s %10s %10s\n",
+                  "phase", "count", "mean", "p50", "p90", "p99", "max");
+    out << line;
+
+    for (int phase = 0; phase < TRACE_PHASES; phase++)
+    {
+        // Merge the histograms of the threads
+        std::vector<uint64_t> counts(BUCKETS, 0);
+        uint64_t              count = 0, total = 0, maximum = 0;
+        for (const auto & trace : threads)
+        {
+            const Histogram & histogram = trace->histograms[phase];
+            for (size_t b = 0; b < BUCKETS; b++)
+            {
+                uint64_t n = histogram.counts[b].load(std::memory_order_relaxed);
+                counts[b] += n;
+                count += n;
+            }
+            total += histogram.total.load(std::memory_order_relaxed);
+            maximum = std::max(
+                maximum, histogram.maximum.load(std::memory_order_relaxed));
+        }
+        if (count == 0)
+            continue;
+
+        auto percentile = [&](double fraction) {
+            uint64_t rank = std::max<uint64_t>(1, fraction * count + 0.5), seen = 0;
+            for (size_t b = 0; b < BUCKETS; b++)
+                if ((seen += counts[b]) >= rank)
+                    return std::min(valueOf(b), maximum);
+            return maximum;
+        };
+
+        std::snprintf(line, sizeof(line),
+                      "%-11s %9llu %10s %10s %10s %10s %10s\n",
+                      PHASE_NAMES[phase].data(),
+                      static_cast<unsigned long long>(count),
+                      formatNanoseconds(double(total) / count).c_str(),
+                      formatNanoseconds(percentile(0.50)).c_str(),
+                      formatNanoseconds(percentile(0.90)).c_str(),
+                      formatNanoseconds(percentile(0.99)).c_str(),
+                      formatNanoseconds(maximum).c_str());
+        out << line;
+    }
+
+    return;
+}
+
+void Tracer::ExportChromeTrace(std::ostream & out)
+{
+    pid_t process = getpid();
+    bool  first   = true;
+    char  event[192];
+
+    out << "{\"traceEvents\":[";
+    for (const auto & trace : registeredThreads())
+    {
+        uint64_t written = trace->written.load(std::memory_order_acquire);
+        for (uint64_t number = written > RING_SIZE ? written - RING_SIZE : 0;
+             number < written; number++)
+        {
+            const Slot & slot = trace->ring[number % RING_SIZE];
+
+            // Copy the slot, then check it is still the same span
+            uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+            uint64_t start    = slot.start.load(std::memory_order_relaxed);
+            uint64_t end      = slot.end.load(std::memory_order_relaxed);
+            int      phase    = slot.phase.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence != number + 1 ||
+                slot.sequence.load(std::memory_order_relaxed) != sequence)
+                continue;
+
+            // The times are in microseconds
+            std::snprintf(event, sizeof(event),
+                          "%s\n{\"name\":\"%s\",\"cat\":\"shell\",\"ph\":\"X\","
+                          "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                          first ? "" : ",", PHASE_NAMES[phase].data(),
+                          start / 1e3, (end - start) / 1e3, process,
+                          trace->thread);
+            out << event;
+            first = false;
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+    return;
+}
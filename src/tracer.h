@@ -0,0 +1,103 @@
+#ifndef _TRACER_H_
+#define _TRACER_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+enum TRACE_PHASE {
+    TRACE_INPUT,      /* Reading a line, the prompt included */
+    TRACE_PARSE,      /* Tokenizing and parsing the line */
+    TRACE_LOOKUP,     /* Finding the builtin or the program */
+    TRACE_REDIRECT,   /* Opening and applying the redirections */
+    TRACE_SPAWN,      /* Starting a child */
+    TRACE_WAIT,       /* Waiting for the foreground children */
+    TRACE_BUILTIN,    /* Running a builtin in the shell */
+    TRACE_COMPLETION, /* Computing a completion */
+    TRACE_PHASES      /* The number of phases */
+};
+
+/**
+ *@brief Record how long the phases of the shell take, when enabled
+ *
+ * Each thread records into its own ring buffer of the last spans and its own
+ * latency histograms, with no lock and no allocation; only the first span of
+ * a thread registers its buffers. The histograms are log-linear, like HDR
+ * histograms: each power of two is split into 16 buckets, so any latency is
+ * known within about 6%. Reading them merges the threads, and a slot of a
+ * ring that is overwritten while it is read is skipped.
+ *
+ * It is enabled by `set -o trace` or by the `SHELL_TRACE` environment
+ * variable; disabled, a span costs a relaxed atomic load.
+ */
+class Tracer
+{
+public:
+    /**
+     *@brief Get the monotonic time in nanoseconds
+     */
+    static uint64_t Now();
+
+    static bool Enabled();
+    static void SetEnabled(bool enabled);
+
+    /**
+     *@brief Record a span of a phase on the calling thread
+     */
+    static void Record(int phase, uint64_t start, uint64_t end);
+
+    /**
+     *@brief Forget the spans and the histograms of every thread
+     */
+    static void Reset();
+
+    static std::string_view PhaseName(int phase);
+
+    /**
+     *@brief Print the count and the latency percentiles of each phase
+     */
+    static void PrintStatistics(std::ostream & out);
+
+    /**
+     *@brief Write the spans in the rings as a Chrome trace, for
+     * `chrome://tracing` or Perfetto
+     */
+    static void ExportChromeTrace(std::ostream & out);
+};
+
+/**
+ *@brief Record the time from its construction to its destruction
+ */
+class TraceSpan
+{
+private:
+    int      phase;
+    uint64_t start = 0; /* 0 if tracing was disabled */
+
+public:
+    explicit TraceSpan(int phase)
+        : phase(phase), start(Tracer::Enabled() ? Tracer::Now() : 0)
+    {
+    }
+    ~TraceSpan()
+    {
+        if (start != 0)
+            Tracer::Record(phase, start, Tracer::Now());
+    }
+
+    TraceSpan(const TraceSpan &)             = delete;
+    TraceSpan & operator=(const TraceSpan &) = delete;
+};
+
+/**
+ *@brief Call a function within a span of a phase
+ *
+ * @return what the function returns
+ */
+template <typename Function> auto traced(int phase, Function && function)
+{
+    TraceSpan span(phase);
+    return function();
+}
+
+#endif // !_TRACER_H_
@@ -1,64 +1,339 @@
 #include "trie.h"
+#include <algorithm>
 
-void Trie::FindPossibleStringByPrefixHelper(
-    std::shared_ptr<TrieNode> & current_node, std::vector<std::string> & result,
-    std::string & prefix)
+namespace
 {
-    for (auto & [next_character, next_node] : current_node->children)
+/**
+ *@brief Order the edges by unsigned byte, as `std::string` compares, so the
+ * words are listed in the order of a sorted vector of strings
+ */
+bool byteLess(char a, char b)
+{
+    return static_cast<unsigned char>(a) < static_cast<unsigned char>(b);
+}
+} // namespace
+
+const Trie::Edge * Trie::FindEdge(NodeIndex node, char first) const
+{
+    const std::vector<Edge> & children = nodes[node].children;
+
+    // Binary search on the sorted edges
+    auto iter = std::lower_bound(
+        children.begin(), children.end(), first,
+        [](const Edge & edge, char ch) { return byteLess(edge.first, ch); });
+
+    return (iter != children.end() && iter->first == first) ? &*iter
+                                                            : nullptr;
+}
+
+Trie::NodeIndex Trie::NewNode(uint32_t label_offset, uint32_t label_length)
+{
+    NodeIndex node;
+
+    // Reuse an erased node before growing the arena
+    if (!free_nodes.empty())
     {
-        // There is no next node
-        if (!next_node)
-            continue;
-
-        // Add the next character to the prefix string
-        prefix.push_back(next_character);
-        if (next_node->is_end) /* If the next node is one end of a word */
-            result.push_back(prefix); /* Add it to the result */
-
-        // Recrusively find the possible string
-        FindPossibleStringByPrefixHelper(next_node, result, prefix);
-        prefix.pop_back(); /* Step back */
+        node = free_nodes.back();
+        free_nodes.pop_back();
+        nodes[node] = Node();
+    }
+    else
+    {
+        node = static_cast<NodeIndex>(nodes.size());
+        nodes.emplace_back();
+    }
+
+    nodes[node].label_offset = label_offset;
+    nodes[node].label_length = label_length;
+
+    return node;
+}
+
+bool Trie::Locate(std::string_view prefix, NodeIndex & node,
+                  std::string_view & rest) const
+{
+    node = ROOT;
+    rest = std::string_view();
+
+    while (!prefix.empty())
+    {
+        const Edge * edge = FindEdge(node, prefix.front());
+        if (!edge) /* Not found */
+            return false;
+
+        node                   = edge->node;
+        std::string_view label = Label(node);
+        size_t           length = std::min(label.size(), prefix.size());
+
+        if (label.compare(0, length, prefix, 0, length) != 0)
+            return false;
+
+        // The prefix ends in the middle of the edge
+        rest   = label.substr(length);
+        prefix = prefix.substr(length);
+    }
+
+    return true;
+}
+
+void Trie::Collect(NodeIndex node, std::vector<std::string> & result,
+                   std::string & word) const
+{
+    if (nodes[node].is_end) /* The node is one end of a word */
+        result.push_back(word);
+
+    // The edges are sorted, so the words come in lexicographic order
+    for (const Edge & edge : nodes[node].children)
+    {
+        word.append(Label(edge.node));
+        Collect(edge.node, result, word);
+        word.resize(word.size() - nodes[edge.node].label_length);
     }
 
     return;
 }
 
-void Trie::Insert(const std::string & word)
+bool Trie::Visit(NodeIndex node, std::string & word,
+                 const std::function<bool(std::string_view)> & visitor) const
+{
+    if (nodes[node].is_end && !visitor(word))
+        return false;
+
+    for (const Edge & edge : nodes[node].children)
+    {
+        word.append(Label(edge.node));
+        bool go_on = Visit(edge.node, word, visitor);
+        word.resize(word.size() - nodes[edge.node].label_length);
+        if (!go_on)
+            return false;
+    }
+
+    return true;
+}
+
+void Trie::Insert(std::string_view word)
 {
-    std::shared_ptr<TrieNode> node = root;
+    NodeIndex node = ROOT;
 
-    for (const char & ch : word)
+    while (!word.empty())
     {
-        if (!node->children[ch])
-            node->children[ch] = std::make_shared<TrieNode>();
+        const Edge * edge = FindEdge(node, word.front());
 
-        node = node->children[ch];
+        // No edge shares the first character, hang the rest as a leaf
+        if (!edge)
+        {
+            NodeIndex leaf =
+                NewNode(static_cast<uint32_t>(labels.size()),
+                        static_cast<uint32_t>(word.size()));
+            labels.append(word);
+            nodes[leaf].is_end = true;
+            word_count++;
+
+            std::vector<Edge> & children = nodes[node].children;
+            children.insert(std::upper_bound(children.begin(), children.end(),
+                                             word.front(),
+                                             [](char ch, const Edge & e) {
+                                                 return byteLess(ch, e.first);
+                                             }),
+                            {word.front(), leaf});
+            return;
+        }
+
+        NodeIndex        child  = edge->node;
+        std::string_view label  = Label(child);
+        size_t           length = 0;
+        while (length < label.size() && length < word.size() &&
+               label[length] == word[length])
+            length++;
+
+        // The edge only shares a part of its label, split it there
+        if (length < label.size())
+        {
+            size_t    edge_position = edge - nodes[node].children.data();
+            NodeIndex middle = NewNode(nodes[child].label_offset, length);
+
+            nodes[child].label_offset += length;
+            nodes[child].label_length -= length;
+            nodes[middle].children.push_back(
+                {labels[nodes[child].label_offset], child});
+            nodes[node].children[edge_position].node = middle;
+            child                                    = middle;
+        }
+
+        node = child;
+        word = word.substr(length);
     }
 
-    node->is_end = true;
+    if (!nodes[node].is_end)
+    {
+        nodes[node].is_end = true;
+        word_count++;
+    }
 
     return;
 }
 
-std::vector<std::string> Trie::FindPossibleStringByPrefix(std::string & prefix)
+void Trie::MergeWithChild(NodeIndex parent, NodeIndex node)
 {
-    std::shared_ptr<TrieNode> node = root;
-    std::vector<std::string>  result;
+    NodeIndex child = nodes[node].children.front().node;
 
-    // Find the prefix at first
-    for (const char & ch : prefix)
+    // The two labels are not adjacent in general, store the joined label
+    uint32_t offset = static_cast<uint32_t>(labels.size());
+    std::string joined(Label(node));
+    joined.append(Label(child));
+    labels.append(joined);
+
+    wasted_labels += nodes[node].label_length + nodes[child].label_length;
+    nodes[child].label_offset = offset;
+    nodes[child].label_length = static_cast<uint32_t>(joined.size());
+
+    // Let the parent point to the child directly
+    for (Edge & edge : nodes[parent].children)
+        if (edge.node == node)
+            edge.node = child;
+
+    nodes[node] = Node();
+    free_nodes.push_back(node);
+
+    return;
+}
+
+bool Trie::Erase(std::string_view word)
+{
+    NodeIndex parent = ROOT, grandparent = ROOT, node = ROOT;
+
+    // Follow the word, remembering the two nodes above
+    while (!word.empty())
+    {
+        const Edge * edge = FindEdge(node, word.front());
+        if (!edge || !word.starts_with(Label(edge->node)))
+            return false;
+
+        grandparent = parent;
+        parent      = node;
+        node        = edge->node;
+        word        = word.substr(nodes[node].label_length);
+    }
+
+    if (!nodes[node].is_end)
+        return false;
+
+    nodes[node].is_end = false;
+    word_count--;
+
+    if (node != ROOT)
+    {
+        if (nodes[node].children.empty())
+        {
+            // Remove the leaf from its parent
+            std::vector<Edge> & children = nodes[parent].children;
+            children.erase(std::find_if(
+                children.begin(), children.end(),
+                [&](const Edge & edge) { return edge.node == node; }));
+
+            wasted_labels += nodes[node].label_length;
+            nodes[node] = Node();
+            free_nodes.push_back(node);
+
+            // The parent may be left as a plain link to a single child
+            if (parent != ROOT && !nodes[parent].is_end &&
+                nodes[parent].children.size() == 1)
+                MergeWithChild(grandparent, parent);
+        }
+        else if (nodes[node].children.size() == 1)
+            MergeWithChild(parent, node);
+    }
+
+    if (wasted_labels > labels.size() / 2)
+        CompactLabels();
+
+    return true;
+}
+
+void Trie::CompactLabels()
+{
+    std::string            compacted;
+    std::vector<NodeIndex> stack = {ROOT};
+
+    compacted.reserve(labels.size() - wasted_labels);
+
+    // Copy the labels of the reachable nodes only
+    while (!stack.empty())
     {
-        // Not found
-        if (!node->children[ch])
-            return result; /* Return empty result */
-        node = node->children[ch];
+        NodeIndex node = stack.back();
+        stack.pop_back();
+
+        std::string_view label   = Label(node);
+        nodes[node].label_offset = static_cast<uint32_t>(compacted.size());
+        compacted.append(label);
+
+        for (const Edge & edge : nodes[node].children)
+            stack.push_back(edge.node);
     }
 
-    if (node->is_end) /* The prefix is a possible word */
-        result.push_back(prefix);
+    labels        = std::move(compacted);
+    wasted_labels = 0;
 
-    // Find the remaining possible strings
-    FindPossibleStringByPrefixHelper(node, result, prefix);
+    return;
+}
+
+std::vector<std::string>
+Trie::FindPossibleStringByPrefix(std::string_view prefix) const
+{
+    std::vector<std::string> result;
+    NodeIndex                node;
+    std::string_view         rest;
+
+    // Find the prefix at first
+    if (!Locate(prefix, node, rest))
+        return result; /* Return empty result */
+
+    // Collect the words under it
+    std::string word(prefix);
+    word.append(rest);
+    Collect(node, result, word);
 
     return result;
 }
+
+void Trie::VisitByPrefix(
+    std::string_view                              prefix,
+    const std::function<bool(std::string_view)> & visitor) const
+{
+    NodeIndex        node;
+    std::string_view rest;
+
+    if (!Locate(prefix, node, rest))
+        return;
+
+    std::string word(prefix);
+    word.append(rest);
+    Visit(node, word, visitor);
+
+    return;
+}
+
+Trie::PrefixMatch Trie::LongestCommonPrefix(std::string_view prefix) const
+{
+    PrefixMatch      match;
+    NodeIndex        node;
+    std::string_view rest;
+
+    if (!Locate(prefix, node, rest) || (node == ROOT && word_count == 0))
+        return match;
+
+    match.found = true;
+    match.common_prefix.assign(prefix);
+    match.common_prefix.append(rest);
+
+    // Follow the path while it does not branch
+    while (!nodes[node].is_end && nodes[node].children.size() == 1)
+    {
+        node = nodes[node].children.front().node;
+        match.common_prefix.append(Label(node));
+    }
+
+    match.unique = nodes[node].is_end && nodes[node].children.empty();
+
+    return match;
+}
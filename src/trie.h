@@ -1,50 +1,168 @@
 #ifndef _TRIE_H_
 #define _TRIE_H_
 
-#include <memory>
-#include <unordered_map>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
 #include <vector>
 
+/**
+ *@brief A path-compressed radix tree
+ *
+ * The nodes live in one contiguous arena and refer to each other by index.
+ * Each edge label is a slice of one shared label buffer, and the children of
+ * a node are kept sorted by the first character of their label, so a
+ * depth-first walk yields the words in lexicographic order.
+ */
 class Trie
 {
 private:
-    class TrieNode
+    using NodeIndex = uint32_t;
+
+    static constexpr NodeIndex ROOT = 0;
+
+    struct Edge
     {
-    public:
-        std::unordered_map<char, std::shared_ptr<TrieNode>> children;
-        bool                                                is_end = false;
+        char      first; /* The first character of the label of `node` */
+        NodeIndex node;
+    };
 
-        TrieNode() {}
-        ~TrieNode() {}
+    struct Node
+    {
+        uint32_t          label_offset = 0; /* The label inside `labels` */
+        uint32_t          label_length = 0;
+        bool              is_end       = false;
+        std::vector<Edge> children; /* Sorted by `first` */
     };
 
-    std::shared_ptr<TrieNode> root;
+    std::vector<Node>      nodes = {Node()}; /* The arena, `nodes[ROOT]` */
+    std::vector<NodeIndex> free_nodes;       /* Erased nodes to reuse */
+    std::string            labels;           /* All the edge labels */
+    size_t                 wasted_labels = 0; /* Bytes no node refers to */
+    size_t                 word_count    = 0;
+
+    /**
+     *@brief Get the label of the edge leading to the node
+     */
+    std::string_view Label(NodeIndex node) const
+    {
+        return std::string_view(labels).substr(nodes[node].label_offset,
+                                               nodes[node].label_length);
+    }
+
+    /**
+     *@brief Find the edge starting with the character
+     *
+     * @return Edge * the edge, or nullptr if there is none
+     */
+    const Edge * FindEdge(NodeIndex node, char first) const;
 
     /**
-     *@brief Help to find the possible string by prefix by dfs method
+     *@brief Allocate a node from the arena
+     *
+     * @param label_offset the offset of its label inside `labels`
+     * @param label_length the length of its label
+     * @return NodeIndex the new node
+     */
+    NodeIndex NewNode(uint32_t label_offset, uint32_t label_length);
+
+    /**
+     *@brief Find the node under which all words with the prefix are
      *
-     * @param current_node the current TrieNode
-     * @param result the array of result
      * @param prefix the prefix
+     * @param node the node found
+     * @param rest the part of the label of `node` after the prefix
+     * @return false if no word starts with the prefix
+     */
+    bool Locate(std::string_view prefix, NodeIndex & node,
+                std::string_view & rest) const;
+
+    /**
+     *@brief Collect the words under the node in lexicographic order
+     *
+     * @param node the current node
+     * @param result the array of result
+     * @param word the word leading to the node
+     */
+    void Collect(NodeIndex node, std::vector<std::string> & result,
+                 std::string & word) const;
+
+    /**
+     *@brief Visit the words under the node in lexicographic order
+     *
+     * @return false if the visitor stopped the walk
+     */
+    bool Visit(NodeIndex node, std::string & word,
+               const std::function<bool(std::string_view)> & visitor) const;
+
+    /**
+     *@brief Merge a node without word into its only child
+     *
+     * @param parent the parent of the node
+     * @param node the node to merge
      */
-    void
-    FindPossibleStringByPrefixHelper(std::shared_ptr<TrieNode> & current_node,
-                                     std::vector<std::string> &  result,
-                                     std::string &               prefix);
+    void MergeWithChild(NodeIndex parent, NodeIndex node);
+
+    /**
+     *@brief Rewrite `labels` without the bytes no node refers to
+     */
+    void CompactLabels();
 
 public:
-    Trie() : root(std::make_shared<TrieNode>()) {}
+    Trie() {}
     ~Trie() {}
 
-    void Insert(const std::string & word);
+    /**
+     *@brief The result of a longest common prefix query
+     */
+    struct PrefixMatch
+    {
+        bool        found  = false; /* Any word starts with the prefix */
+        bool        unique = false; /* Exactly one word starts with it */
+        std::string common_prefix;  /* The longest prefix shared by them */
+    };
+
+    void Insert(std::string_view word);
+
+    /**
+     *@brief Erase a word
+     *
+     * @param word the word to erase
+     * @return false if the word is not in the tree
+     */
+    bool Erase(std::string_view word);
 
     /**
      *@brief Find the possible string with the prefix
      *
      * @param prefix
-     * @return std::vector<std::string> all possible strings
+     * @return std::vector<std::string> all possible strings, sorted
+     */
+    std::vector<std::string>
+    FindPossibleStringByPrefix(std::string_view prefix) const;
+
+    /**
+     *@brief Visit the words with the prefix in lexicographic order
+     *
+     * Nothing is collected, so a walk over many words only costs the walk.
+     *
+     * @param prefix the prefix
+     * @param visitor called with each word, returns false to stop the walk
      */
-    std::vector<std::string> FindPossibleStringByPrefix(std::string & prefix);
+    void VisitByPrefix(
+        std::string_view                              prefix,
+        const std::function<bool(std::string_view)> & visitor) const;
+
+    /**
+     *@brief Get the longest common prefix of the words with the prefix
+     *
+     * @param prefix the prefix
+     * @return PrefixMatch the common prefix and whether it is unique
+     */
+    PrefixMatch LongestCommonPrefix(std::string_view prefix) const;
+
+    size_t Size() const { return word_count; }
 };
 
-#endif // !_TRIE_H_
\ No newline at end of file
+#endif // !_TRIE_H_
@@ -0,0 +1,190 @@
+#include "variables.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <unistd.h>
+
+Environment::Environment(std::vector<std::string> entries)
+    : entries(std::move(entries))
+{
+    // The entries are final, so the pointers into them stay valid
+    pointers.reserve(this->entries.size() + 1);
+    for (std::string & entry : this->entries)
+        pointers.push_back(entry.data());
+    pointers.push_back(nullptr);
+}
+
+bool VariableStore::IsName(std::string_view name)
+{
+    if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0])))
+        return false;
+
+    return std::all_of(name.begin(), name.end(), [](char ch) {
+        return std::isalnum(static_cast<unsigned char>(ch)) || ch == '_';
+    });
+}
+
+void VariableStore::Import(char ** envp)
+{
+    for (; envp && *envp; envp++)
+    {
+        std::string_view entry = *envp;
+        size_t           equal = entry.find('=');
+        if (equal == std::string_view::npos || !IsName(entry.substr(0, equal)))
+            continue;
+
+        Set(entry.substr(0, equal), entry.substr(equal + 1));
+        Export(entry.substr(0, equal));
+    }
+
+    return;
+}
+
+std::optional<std::string_view> VariableStore::Get(std::string_view name) const
+{
+    if (name.size() == 1 && !IsName(name))
+    {
+        long value = 0;
+        switch (name[0])
+        {
+        case '?': value = status; break;
+        case '$': value = getpid(); break;
+        case '!':
+            if (last_background == 0)
+                return std::nullopt;
+            value = last_background;
+            break;
+        case '0': return "shell";
+        default: return std::nullopt;
+        }
+
+        char * end = std::to_chars(special, special + sizeof(special), value).ptr;
+        return std::string_view(special, end - special);
+    }
+
+    auto iter = variables.find(name);
+    if (iter == variables.end() || !iter->second.assigned)
+        return std::nullopt;
+
+    return iter->second.value;
+}
+
+void VariableStore::Set(std::string_view name, std::string_view value)
+{
+    auto iter = variables.find(name);
+    if (iter == variables.end())
+        iter = variables.emplace(std::string(name), Variable()).first;
+
+    Variable & variable = iter->second;
+    variable.value.assign(value);
+    variable.assigned = true;
+
+    if (variable.exported)
+        environment.reset();
+
+    return;
+}
+
+void VariableStore::Export(std::string_view name, bool exported)
+{
+    auto iter = variables.find(name);
+    if (iter == variables.end())
+    {
+        // `export NAME` only marks a variable assigned later
+        if (!exported)
+            return;
+        iter = variables.emplace(std::string(name), Variable{"", true, false})
+                   .first;
+    }
+
+    if (iter->second.exported != exported)
+    {
+        iter->second.exported = exported;
+        environment.reset();
+    }
+
+    return;
+}
+
+void VariableStore::Unset(std::string_view name)
+{
+    auto iter = variables.find(name);
+    if (iter == variables.end())
+        return;
+
+    if (iter->second.exported)
+        environment.reset();
+    variables.erase(iter);
+
+    return;
+}
+
+std::shared_ptr<const Environment> VariableStore::GetEnvironment() const
+{
+    if (environment)
+        return environment;
+
+    std::vector<std::string> entries;
+    for (const auto & [name, variable] : variables)
+        if (variable.exported && variable.assigned)
+            entries.push_back(name + "=" + variable.value);
+
+    environment = std::make_shared<const Environment>(std::move(entries));
+
+    return environment;
+}
+
+std::shared_ptr<const Environment>
+VariableStore::GetEnvironment(std::span<const std::string_view> assignments) const
+{
+    std::vector<std::string> entries;
+    for (const auto & [name, variable] : variables)
+    {
+        if (!variable.exported || !variable.assigned)
+            continue;
+
+        // An assignment replaces the exported value
+        bool overridden =
+            std::any_of(assignments.begin(), assignments.end(),
+                        [&](std::string_view assignment) {
+                            return assignment.starts_with(name) &&
+                                   assignment.size() > name.size() &&
+                                   assignment[name.size()] == '=';
+                        });
+        if (!overridden)
+            entries.push_back(name + "=" + variable.value);
+    }
+
+    // The last assignment of a name wins
+    for (size_t i = 0; i < assignments.size(); i++)
+    {
+        std::string_view name =
+            assignments[i].substr(0, assignments[i].find('='));
+        bool repeated = std::any_of(
+            assignments.begin() + i + 1, assignments.end(),
+            [&](std::string_view later) {
+                return later.substr(0, later.find('=')) == name;
+            });
+        if (!repeated)
+            entries.emplace_back(assignments[i]);
+    }
+
+    return std::make_shared<const Environment>(std::move(entries));
+}
+
+std::vector<std::pair<std::string_view, std::optional<std::string_view>>>
+VariableStore::Exported() const
+{
+    std::vector<std::pair<std::string_view, std::optional<std::string_view>>>
+        exported;
+    for (const auto & [name, variable] : variables)
+        if (variable.exported)
+            exported.emplace_back(
+                name, variable.assigned
+                          ? std::optional<std::string_view>(variable.value)
+                          : std::nullopt);
+
+    std::sort(exported.begin(), exported.end());
+
+    return exported;
+}
@@ -0,0 +1,133 @@
+#ifndef _VARIABLES_H_
+#define _VARIABLES_H_
+
+#include "tools.h"
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ *@brief The environment given to the children, `NAME=value` entries
+ *
+ * It never changes once built, so a spawn on any thread can use it while
+ * the shell builds the next one.
+ */
+class Environment
+{
+private:
+    std::vector<std::string> entries;
+    std::vector<char *>      pointers; /* Into `entries`, nullptr ended */
+
+public:
+    explicit Environment(std::vector<std::string> entries);
+    ~Environment() {}
+
+    Environment(const Environment &)             = delete;
+    Environment & operator=(const Environment &) = delete;
+
+    /**
+     *@brief Get the array to pass as the `envp` of a program
+     */
+    char * const * Pointers() const { return pointers.data(); }
+};
+
+/**
+ *@brief The variables of the shell, local or exported
+ *
+ * The exported ones make the environment of the children. It is built once
+ * and shared until an exported variable changes, so spawning a program does
+ * not copy the environment. The special parameters `$?`, `$$` and `$!` are
+ * kept apart and formatted when read.
+ */
+class VariableStore
+{
+private:
+    struct Variable
+    {
+        std::string value;
+        bool        exported = false;
+        bool        assigned = true; /* False for `export NAME` alone */
+    };
+
+    std::unordered_map<std::string, Variable, StringHash, std::equal_to<>>
+                                              variables;
+    mutable std::shared_ptr<const Environment> environment; /* nullptr if stale */
+    int   status          = 0;
+    pid_t last_background = 0;
+    mutable char special[24];   /* The text of the special parameter read */
+
+public:
+    VariableStore() {}
+    ~VariableStore() {}
+
+    VariableStore(const VariableStore &)             = delete;
+    VariableStore & operator=(const VariableStore &) = delete;
+
+    /**
+     *@brief Check whether a text is a valid variable name
+     */
+    static bool IsName(std::string_view name);
+
+    /**
+     *@brief Import the environment of the shell as exported variables
+     */
+    void Import(char ** envp);
+
+    /**
+     *@brief Get the value of a variable
+     *
+     * @param name the name, or `?`, `$`, `!` or `0`
+     * @return std::optional<std::string_view> the value, valid until the
+     * store changes or another special parameter is read, nullopt if unset
+     */
+    std::optional<std::string_view> Get(std::string_view name) const;
+
+    /**
+     *@brief Set a variable, which stays exported if it was
+     */
+    void Set(std::string_view name, std::string_view value);
+
+    /**
+     *@brief Export a variable or stop exporting it
+     */
+    void Export(std::string_view name, bool exported = true);
+
+    /**
+     *@brief Remove a variable
+     */
+    void Unset(std::string_view name);
+
+    /**
+     *@brief Get the environment of the children, built if it is stale
+     */
+    std::shared_ptr<const Environment> GetEnvironment() const;
+
+    /**
+     *@brief Build the environment with some variables overridden, for the
+     * assignments before a command
+     *
+     * @param assignments the `NAME=value` words
+     */
+    std::shared_ptr<const Environment>
+    GetEnvironment(std::span<const std::string_view> assignments) const;
+
+    void SetStatus(int new_status) { status = new_status; }
+    void SetLastBackground(pid_t pid) { last_background = pid; }
+
+    /**
+     *@brief List the exported variables, sorted by name
+     *
+     * @return std::vector<std::pair<std::string_view, std::optional<std::string_view>>>
+     * the names and values, nullopt for the ones never assigned
+     */
+    std::vector<
+        std::pair<std::string_view, std::optional<std::string_view>>>
+    Exported() const;
+};
+
+#endif // !_VARIABLES_H_